@@ -1,10 +1,13 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec3 aTangent;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform mat3 normalMatrix;
 uniform vec3 mainDirection;
 
 out vec2 ourTexCoord;
@@ -15,15 +18,11 @@ out vec3 binormal;
 
 void main()
 {
-    vec4 vertPos = vec4(aPos, 1.0);
-    gl_Position = projection * view * model * vertPos;
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
     ourMainDirection = (view * vec4(mainDirection, 1.0)).rgb;
     ourTexCoord = aTexCoord;
-    
-    mat4 modelView  = view * model;
-    mat4 modelViewIt = transpose(inverse(modelView));
 
-    normal = normalize((modelViewIt * vec4(0, 0, 1, 1)).xyz);
-    tangent = normalize((modelViewIt * vec4(0, -1, 0, 1)).xyz);
-    binormal = normalize((modelViewIt * vec4(-1, 0, 0, 1)).xyz);
-}
\ No newline at end of file
+    normal = normalize(normalMatrix * aNormal);
+    tangent = normalize(normalMatrix * aTangent);
+    binormal = normalize(normalMatrix * cross(aTangent, aNormal));
+}
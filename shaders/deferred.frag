@@ -0,0 +1,115 @@
+#version 330 core
+// Number of shadow cascades, 0 for none
+#ifndef SHADOWS
+#define SHADOWS 0
+#endif
+// Sky and block light from the flood-filled volume, see LightVolumeComponent
+#ifndef LIGHT_VOLUME
+#define LIGHT_VOLUME 0
+#endif
+in vec2 ourTexCoord;
+
+uniform mat4 view;
+uniform float ambient;
+uniform float diffuse;
+uniform vec4 lightColor;
+uniform vec4 lightSource;
+
+// The G-buffer, albedo and view space normal with the relief shadow in alpha
+uniform sampler2D albedoTex;
+uniform sampler2D normalTex;
+uniform sampler2D depthTex;
+
+// Point lights, see LightClusters
+uniform mat4 inverseProjection;
+uniform samplerBuffer lightData;
+uniform usamplerBuffer lightGrid;
+uniform usamplerBuffer lightIndices;
+uniform ivec3 clusterCount;
+uniform float clusterNear;
+uniform float clusterFar;
+
+#if SHADOWS
+// Cascaded shadow map, see ShadowCascades
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[SHADOWS];
+uniform float shadowRanges[SHADOWS];
+
+float cascadeShadow(vec3 viewPos)
+{
+    float dist = length(viewPos);
+    for (int i = 0; i < SHADOWS; ++i) {
+        if (dist < shadowRanges[i]) {
+            vec4 coord = shadowMatrices[i] * vec4(viewPos, 1);
+            return texture(shadowMap, vec4(coord.xy, i, coord.z));
+        }
+    }
+    return 1.0;
+}
+#endif
+
+#if LIGHT_VOLUME
+// Flood-filled light, 4 bits of sky then 4 of block light per voxel
+uniform usampler3D lightVolume;
+uniform ivec3 lightVolumeLowerBound;
+uniform mat4 inverseView;
+const vec3 BLOCK_LIGHT = vec3(1.0, 0.85, 0.6);
+
+// Sky and block light of the voxel in front of a surface point, each level
+// 80% of the one above it
+vec2 volumeLight(vec3 worldPos, vec3 worldNormal)
+{
+    ivec3 size = textureSize(lightVolume, 0);
+    ivec3 voxel = ivec3(floor(worldPos + worldNormal * 0.5));
+    // Past the ring nothing was lit, clipmaps are under the open sky
+    ivec3 local = voxel - lightVolumeLowerBound;
+    if (any(lessThan(local, ivec3(0))) || any(greaterThanEqual(local, size))) {
+        return vec2(1.0, 0.0);
+    }
+    uint levels = texelFetch(lightVolume, voxel & (size - 1), 0).r;
+    return pow(vec2(0.8), 15.0 - vec2(levels >> 4, levels & 15u));
+}
+#endif
+
+out vec4 fragColor;
+
+void main()
+{
+    vec4 albedo = texture(albedoTex, ourTexCoord);
+    if (albedo.a == 0) {
+        discard;
+    }
+    vec4 normalShadow = texture(normalTex, ourTexCoord);
+    vec3 normal = normalize(normalShadow.xyz * 2 - 1);
+    float shadow = normalShadow.a;
+    vec4 ndc = vec4(ourTexCoord, texture(depthTex, ourTexCoord).r, 1) * 2 - 1;
+    vec4 viewPos = inverseProjection * ndc;
+    vec3 pos = viewPos.xyz / viewPos.w;
+#if SHADOWS
+    shadow *= cascadeShadow(pos);
+#endif
+
+    // Same light as relief.frag
+    vec3 lightPos = normalize(mat3(view) * -lightSource.xyz);
+    fragColor.a = albedo.a;
+    fragColor.rgb = albedo.rgb*ambient + shadow*clamp(albedo.rgb * lightColor.rgb * dot(lightPos, normal), 0, 1)*diffuse;
+#if LIGHT_VOLUME
+    vec2 level = volumeLight((inverseView * vec4(pos, 1)).xyz, mat3(inverseView) * normal);
+    fragColor.rgb = max(fragColor.rgb * level.x, albedo.rgb * BLOCK_LIGHT * level.y);
+#endif
+
+    // Only the lights assigned to this fragment cluster
+    int slice = int(log(-pos.z / clusterNear) / log(clusterFar / clusterNear) * clusterCount.z);
+    ivec2 tile = ivec2(ourTexCoord * clusterCount.xy);
+    ivec3 cluster = clamp(ivec3(tile, slice), ivec3(0), clusterCount - 1);
+    uvec2 range = texelFetch(lightGrid, (cluster.z * clusterCount.y + cluster.y) * clusterCount.x + cluster.x).xy;
+    for (uint i = 0u; i < range.y; ++i) {
+        int light = int(texelFetch(lightIndices, int(range.x + i)).r);
+        vec4 sphere = texelFetch(lightData, light * 2);
+        vec3 color = texelFetch(lightData, light * 2 + 1).rgb;
+        vec3 toLight = sphere.xyz - pos;
+        float dist = length(toLight);
+        float attenuation = clamp(1 - dist / sphere.w, 0, 1);
+        fragColor.rgb += albedo.rgb * color * max(dot(normal, toLight / dist), 0) * attenuation * attenuation * diffuse;
+    }
+}
@@ -0,0 +1,12 @@
+#version 330 core
+in vec2 ourTexCoord;
+
+uniform sampler2D inputTex;
+
+// The relief.frag discard with DEPTH_PRE_PASS, so holes do not get depth
+void main()
+{
+    if (texture(inputTex, ourTexCoord).a <= 0.125) {
+        discard;
+    }
+}
@@ -0,0 +1,19 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoord;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec2 ourTexCoord;
+
+// Must match relief.vert bit for bit, the relief pass tests depth with EQUAL
+invariant gl_Position;
+
+void main()
+{
+    vec4 viewPos = view * model * vec4(aPos, 1.0);
+    gl_Position = projection * viewPos;
+    ourTexCoord = aTexCoord;
+}
@@ -0,0 +1,43 @@
+#version 330 core
+// Write the G-buffer instead of lighting, see deferred.frag
+#ifndef DEFERRED
+#define DEFERRED 0
+#endif
+
+in vec2 ourTexCoord;
+
+// The atlas, albedo with the occlusion baked in and world space normal
+uniform sampler2D inputTex;
+uniform sampler2D normalTex;
+uniform mat4 view;
+uniform mat3 normalMatrix;
+uniform float ambient;
+uniform float diffuse;
+uniform vec4 lightColor;
+uniform vec4 lightSource;
+
+#if DEFERRED
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec4 fragNormal;
+#else
+out vec4 fragColor;
+#endif
+
+void main()
+{
+    vec4 albedo = texture(inputTex, ourTexCoord);
+    // Cleared where the section had nothing
+    if (albedo.a == 0) {
+        discard;
+    }
+    vec3 normal = normalize(normalMatrix * (texture(normalTex, ourTexCoord).xyz * 2 - 1));
+#if DEFERRED
+    fragColor = albedo;
+    fragNormal = vec4(normal * 0.5 + 0.5, 1);
+#else
+    // Same light as simple.vert, per pixel
+    vec3 lightPos = normalize(mat3(view) * -lightSource.xyz);
+    vec3 light = clamp(albedo.rgb * lightColor.rgb * dot(lightPos, normal), 0, 1) * diffuse;
+    fragColor = vec4(albedo.rgb * ambient + light, albedo.a);
+#endif
+}
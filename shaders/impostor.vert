@@ -0,0 +1,15 @@
+#version 330 core
+// Quads facing the direction each snapshot was taken from, see SectionImpostors
+layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec2 aTexCoord;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec2 ourTexCoord;
+
+void main()
+{
+    gl_Position = projection * view * vec4(aPos, 1.0);
+    ourTexCoord = aTexCoord;
+}
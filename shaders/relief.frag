@@ -1,4 +1,37 @@
 #version 330 core
+// Permutation switches, ResourcePool defines them before this point
+#ifndef LINEAR_SEARCH_STEPS
+#define LINEAR_SEARCH_STEPS 15
+#endif
+#ifndef BINARY_SEARCH_STEPS
+#define BINARY_SEARCH_STEPS 5
+#endif
+#ifndef PARALLAX
+#define PARALLAX 1
+#endif
+#ifndef SELF_SHADOW
+#define SELF_SHADOW 1
+#endif
+#ifndef NORMAL_MAPPING
+#define NORMAL_MAPPING 1
+#endif
+// Depth was laid down by depth.frag, only its coverage test may discard here
+#ifndef DEPTH_PRE_PASS
+#define DEPTH_PRE_PASS 0
+#endif
+// Write the G-buffer instead of lighting, see deferred.frag
+#ifndef DEFERRED
+#define DEFERRED 0
+#endif
+// Number of shadow cascades, 0 for none
+#ifndef SHADOWS
+#define SHADOWS 0
+#endif
+// Sky and block light from the flood-filled volume, see LightVolumeComponent
+#ifndef LIGHT_VOLUME
+#define LIGHT_VOLUME 0
+#endif
+
 in vec2 ourTexCoord;
 in vec3 pos;
 in vec3 normal;
@@ -14,15 +47,67 @@ uniform float diffuse;
 uniform vec4 lightColor;
 uniform vec4 lightSource;
 
+#if DEFERRED
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec4 fragNormal;
+#else
 out vec4 fragColor;
+#endif
 uniform sampler2D inputTex;   
 uniform sampler2D reliefTex;
 
+// Adaptive search, LINEAR_SEARCH_STEPS and BINARY_SEARCH_STEPS are the limits
+uniform float reliefStepsPerPixel;
+uniform int reliefMinSteps;
+
+#if SHADOWS && !DEFERRED
+// Cascaded shadow map, see ShadowCascades
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[SHADOWS];
+uniform float shadowRanges[SHADOWS];
+
+float cascadeShadow(vec3 viewPos)
+{
+    float dist = length(viewPos);
+    for (int i = 0; i < SHADOWS; ++i) {
+        if (dist < shadowRanges[i]) {
+            vec4 coord = shadowMatrices[i] * vec4(viewPos, 1);
+            return texture(shadowMap, vec4(coord.xy, i, coord.z));
+        }
+    }
+    return 1.0;
+}
+#endif
+
+#if LIGHT_VOLUME && !DEFERRED
+in vec3 worldPos;
+in vec3 worldNormal;
+
+// Flood-filled light, 4 bits of sky then 4 of block light per voxel
+uniform usampler3D lightVolume;
+uniform ivec3 lightVolumeLowerBound;
+const vec3 BLOCK_LIGHT = vec3(1.0, 0.85, 0.6);
+
+// Sky and block light of the voxel in front of a surface point, each level
+// 80% of the one above it
+vec2 volumeLight(vec3 worldPos, vec3 worldNormal)
+{
+    ivec3 size = textureSize(lightVolume, 0);
+    ivec3 voxel = ivec3(floor(worldPos + worldNormal * 0.5));
+    // Past the ring nothing was lit, clipmaps are under the open sky
+    ivec3 local = voxel - lightVolumeLowerBound;
+    if (any(lessThan(local, ivec3(0))) || any(greaterThanEqual(local, size))) {
+        return vec2(1.0, 0.0);
+    }
+    uint levels = texelFetch(lightVolume, voxel & (size - 1), 0).r;
+    return pow(vec2(0.8), 15.0 - vec2(levels >> 4, levels & 15u));
+}
+#endif
+
 ///Auxiliar
-float rayIntersect(vec2 dp, vec2 ds) {
-    const int linear_search_steps=15;
-	const int binary_search_steps=5;
-	float depth_step=1.0/linear_search_steps;
+// Gradients are explicit, since the loops are not in uniform control flow
+float rayIntersect(vec2 dp, vec2 ds, vec2 dx, vec2 dy, int linearSteps, int binarySteps) {
+	float depth_step=1.0/linearSteps;
 
 	// current size of search window
 	float size=depth_step;
@@ -31,20 +116,20 @@ float rayIntersect(vec2 dp, vec2 ds) {
 	// best match found (starts with last position 1.0)
 	float best_depth=1.0;
 
-	for(int i = 0; i < linear_search_steps-1; ++i) {
+	for(int i = 0; i < LINEAR_SEARCH_STEPS-1 && i < linearSteps-1; ++i) {
         depth += size;
-        float t = texture(reliefTex, dp+ds*depth).w;
-
-        if(best_depth > 0.996) // if has no depth found
-        if(depth >= t)
+        float t = textureGrad(reliefTex, dp+ds*depth, dx, dy).w;
+        if(depth >= t) {
             best_depth = depth; // store the best depth.
+            break;
+        }
 	}
 	depth = best_depth;
 
 	//Recurse arround first point (depth) for closest match
-	for( int i=0;i<binary_search_steps;i++ ) {
+	for( int i=0;i<BINARY_SEARCH_STEPS && i<binarySteps;i++ ) {
         size *= 0.5;
-        float t = texture(reliefTex, dp+ds*depth).w;
+        float t = textureGrad(reliefTex, dp+ds*depth, dx, dy).w;
         if(depth >= t) {
             best_depth = depth;
             depth -= 2*size;
@@ -59,42 +144,81 @@ void main()
 {
     float tile = 1;
     float depth = 0.0625f;
-    vec3 lightPos;
-    // if (lightColor.a <= 0.1) {
-        lightPos = normalize((projection *  vec4(lightSource.xyz, 1)).xyz);
-    // } else {
-    //     lightPos = lightSource.xyz;
-    // }
+    // Toward the light in view space, lightSource is the world space
+    // direction it travels, as the shadow cascades take it
+    vec3 lightPos = normalize(mat3(view) * -lightSource.xyz);
 
     vec3 v  = normalize(pos);
     float a = dot(normal, -v);
+    float shadow = 1.0;
+#if PARALLAX
     vec3 s  = normalize(vec3(dot(v, binormal), dot(v, tangent), a));
     s *= depth/a;
     vec2 ds = s.xy;
     vec2 dp = ourTexCoord*tile;
-    float d = rayIntersect(dp, ds);
+    vec2 dx = dFdx(dp);
+    vec2 dy = dFdy(dp);
+
+    // One linear step per reliefStepsPerPixel of parallax on screen, so
+    // grazing and distant faces stop paying for invisible detail
+    float texCoordPerPixel = max(max(length(dx), length(dy)), 1e-6);
+    float shiftPixels = length(ds) / texCoordPerPixel;
+    int linearSteps = int(clamp(ceil(shiftPixels * reliefStepsPerPixel),
+                                float(min(reliefMinSteps, LINEAR_SEARCH_STEPS)),
+                                float(LINEAR_SEARCH_STEPS)));
+    // Refine until the window is a pixel wide
+    int binarySteps = int(clamp(ceil(log2(max(shiftPixels / linearSteps, 1.0))) + 1,
+                                1.0,
+                                float(BINARY_SEARCH_STEPS)));
+
+    float d = rayIntersect(dp, ds, dx, dy, linearSteps, binarySteps);
     vec2 texCoord = dp + (ds * d);
 
-    //Shadow
-    float shadow = 1.0;
-    // if (shadowFactor != 0){
+#if SELF_SHADOW
+    a = dot(normal, lightPos);
+    // Facing away from the light it is already dark
+    if (a > 0) {
         dp += ds * d;
-        a = dot(normal, lightPos);
         s  = normalize(vec3(dot(v, binormal), dot(v, tangent), a));s *= depth/a;
         ds = s.xy;
         dp -= ds*d;
-        float dl = rayIntersect(dp, ds);
+        float dl = rayIntersect(dp, ds, dx, dy, linearSteps, binarySteps);
         if( dl < d - 0.05) {
             shadow = 0.151515;
         }
-    // }
+    }
+#endif
+#else
+    vec2 texCoord = ourTexCoord*tile;
+#endif
+#if SHADOWS && !DEFERRED
+    shadow *= cascadeShadow(pos);
+#endif
 
     vec4 ourColor = texture(inputTex, texCoord );
+#if DEPTH_PRE_PASS
+    // The unshifted coverage of depth.frag, or pixels would get depth and no
+    // color, or hide what is behind them without depth
+    ourColor.a = texture(inputTex, ourTexCoord*tile).a;
+#endif
     if (ourColor.a > 0.125) {
+#if NORMAL_MAPPING
         vec3 dNormal = texture(reliefTex, texCoord).xyz * 2 - 1;
         vec3 nNormal = normalize(binormal*dNormal.x + tangent*dNormal.y + normal*dNormal.z);
+#else
+        vec3 nNormal = normal;
+#endif
+#if DEFERRED
+        fragColor = ourColor * tint;
+        fragNormal = vec4(nNormal * 0.5 + 0.5, shadow);
+#else
         fragColor.a = ourColor.a * tint.a;
         fragColor.rgb = ourColor.rgb*ambient + shadow*clamp((ourColor * tint * vec4(lightColor.xyz, 1) * dot(lightPos, nNormal)).xyz, 0, 1)*diffuse ;
+#if LIGHT_VOLUME
+        vec2 level = volumeLight(worldPos, worldNormal);
+        fragColor.rgb = max(fragColor.rgb * level.x, ourColor.rgb * tint.rgb * BLOCK_LIGHT * level.y);
+#endif
+#endif
     } else {
         discard;
     }
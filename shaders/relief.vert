@@ -1,29 +1,46 @@
 #version 330 core
+#ifndef DEFERRED
+#define DEFERRED 0
+#endif
+// Sky and block light from the flood-filled volume, see LightVolumeComponent
+#ifndef LIGHT_VOLUME
+#define LIGHT_VOLUME 0
+#endif
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+layout (location = 3) in vec3 aTangent;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
-uniform vec3 mainDirection;
+uniform mat3 normalMatrix;
 
 out vec2 ourTexCoord;
 out vec3 pos;
 out vec3 normal;
 out vec3 tangent;
 out vec3 binormal;
+#if LIGHT_VOLUME && !DEFERRED
+out vec3 worldPos;
+out vec3 worldNormal;
+#endif
+
+// The depth pre-pass computes the same position, see depth.vert
+invariant gl_Position;
 
 void main()
 {
-    vec4 vertPos = vec4(aPos, 1.0);
-    gl_Position = projection * view * model * vertPos;
+    vec4 viewPos = view * model * vec4(aPos, 1.0);
+    gl_Position = projection * viewPos;
     ourTexCoord = aTexCoord;
-    
-    mat4 modelView  = view * model;
-    mat4 modelViewIt = transpose(inverse(modelView));
 
-    pos = (modelView * vertPos).xyz;
-    normal = normalize((modelViewIt * vec4(0, 0, 1, 1)).xyz);
-    tangent = normalize((modelViewIt * vec4(0, -1, 0, 1)).xyz);
-    binormal = normalize((modelViewIt * vec4(-1, 0, 0, 1)).xyz);
-}
\ No newline at end of file
+    pos = viewPos.xyz;
+    normal = normalize(normalMatrix * aNormal);
+    tangent = normalize(normalMatrix * aTangent);
+    binormal = normalize(normalMatrix * cross(aTangent, aNormal));
+#if LIGHT_VOLUME && !DEFERRED
+    worldPos = (model * vec4(aPos, 1.0)).xyz;
+    worldNormal = mat3(model) * aNormal;
+#endif
+}
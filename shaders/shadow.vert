@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+// Section meshes are already in world coordinates, see ShadowCascades
+uniform mat4 lightViewProjection;
+
+void main()
+{
+    gl_Position = lightViewProjection * vec4(aPos, 1.0);
+}
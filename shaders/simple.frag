@@ -1,12 +1,109 @@
 #version 330 core
+#ifndef DEFERRED
+#define DEFERRED 0
+#endif
+// Number of shadow cascades, 0 for none
+#ifndef SHADOWS
+#define SHADOWS 0
+#endif
+// Sky and block light from the flood-filled volume, see LightVolumeComponent
+#ifndef LIGHT_VOLUME
+#define LIGHT_VOLUME 0
+#endif
+// Clipmap sections, the finer levels draw inside the hole
+#ifndef CLIPMAP_HOLE
+#define CLIPMAP_HOLE 0
+#endif
+
 in vec2 ourTexCoord;
 in vec4 ourColor;
 
-out vec4 fragColor;
 uniform sampler2D inputTex;   
 
+#if DEFERRED
+in vec3 normal;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec4 fragNormal;
+#else
+out vec4 fragColor;
+#endif
+
+#if SHADOWS && !DEFERRED
+in vec3 pos;
+in vec3 ourLight;
+
+// Cascaded shadow map, see ShadowCascades
+uniform sampler2DArrayShadow shadowMap;
+uniform mat4 shadowMatrices[SHADOWS];
+uniform float shadowRanges[SHADOWS];
+
+float cascadeShadow(vec3 viewPos)
+{
+    float dist = length(viewPos);
+    for (int i = 0; i < SHADOWS; ++i) {
+        if (dist < shadowRanges[i]) {
+            vec4 coord = shadowMatrices[i] * vec4(viewPos, 1);
+            return texture(shadowMap, vec4(coord.xy, i, coord.z));
+        }
+    }
+    return 1.0;
+}
+#endif
+
+#if LIGHT_VOLUME && !DEFERRED
+in vec3 worldPos;
+in vec3 worldNormal;
+in vec3 ourBase;
+
+// Flood-filled light, 4 bits of sky then 4 of block light per voxel
+uniform usampler3D lightVolume;
+uniform ivec3 lightVolumeLowerBound;
+const vec3 BLOCK_LIGHT = vec3(1.0, 0.85, 0.6);
+
+// Sky and block light of the voxel in front of a surface point, each level
+// 80% of the one above it
+vec2 volumeLight(vec3 worldPos, vec3 worldNormal)
+{
+    ivec3 size = textureSize(lightVolume, 0);
+    ivec3 voxel = ivec3(floor(worldPos + worldNormal * 0.5));
+    // Past the ring nothing was lit, clipmaps are under the open sky
+    ivec3 local = voxel - lightVolumeLowerBound;
+    if (any(lessThan(local, ivec3(0))) || any(greaterThanEqual(local, size))) {
+        return vec2(1.0, 0.0);
+    }
+    uint levels = texelFetch(lightVolume, voxel & (size - 1), 0).r;
+    return pow(vec2(0.8), 15.0 - vec2(levels >> 4, levels & 15u));
+}
+#endif
+
+#if CLIPMAP_HOLE
+in vec3 holePos;
+
+// World box covered by the next finer level, see PerspectiveRenderComponent
+uniform vec3 holeLowerBound;
+uniform vec3 holeHigherBound;
+#endif
+
 void main()
 {
+#if CLIPMAP_HOLE
+    if (all(greaterThanEqual(holePos, holeLowerBound)) && all(lessThan(holePos, holeHigherBound))) {
+        discard;
+    }
+#endif
     vec4 mainColor = texture(inputTex, ourTexCoord);
-    fragColor      = mainColor * ourColor;
+    vec3 light     = ourColor.rgb;
+#if SHADOWS && !DEFERRED
+    light         += ourLight * cascadeShadow(pos);
+#endif
+#if LIGHT_VOLUME && !DEFERRED
+    // The sky dims the sun and ambient, block light only adds where brighter
+    vec2 level     = volumeLight(worldPos, worldNormal);
+    light          = max(light * level.x, ourBase * BLOCK_LIGHT * level.y);
+#endif
+    fragColor      = mainColor * vec4(light, ourColor.a);
+#if DEFERRED
+    fragNormal     = vec4(normalize(normal) * 0.5 + 0.5, 1);
+#endif
 }
@@ -1,27 +1,93 @@
 #version 330 core
+// Write the G-buffer instead of lighting, see deferred.frag
+#ifndef DEFERRED
+#define DEFERRED 0
+#endif
+// Number of shadow cascades, 0 for none
+#ifndef SHADOWS
+#define SHADOWS 0
+#endif
+// Sky and block light from the flood-filled volume, see LightVolumeComponent
+#ifndef LIGHT_VOLUME
+#define LIGHT_VOLUME 0
+#endif
+// Per vertex ambient occlusion, given by section meshes
+#ifndef OCCLUSION
+#define OCCLUSION 0
+#endif
+// Clipmap sections, cut where the finer levels draw, see simple.frag
+#ifndef CLIPMAP_HOLE
+#define CLIPMAP_HOLE 0
+#endif
+
 layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+#if OCCLUSION
+layout (location = 4) in float aOcclusion;
+#endif
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform mat3 normalMatrix;
 uniform vec4 tint;
-uniform vec3 ambientColor;
-uniform vec3 mainColor;
-uniform vec3 mainDirection;
+uniform float ambient;
+uniform float diffuse;
+uniform vec4 lightColor;
+uniform vec4 lightSource;
 
 out vec2 ourTexCoord;
 out vec4 ourColor;
+#if DEFERRED
+out vec3 normal;
+#elif SHADOWS
+// The light is left apart, to be shadowed per fragment
+out vec3 pos;
+out vec3 ourLight;
+#endif
+#if LIGHT_VOLUME && !DEFERRED
+// Where to look the volume up, and the unlit color block light multiplies
+out vec3 worldPos;
+out vec3 worldNormal;
+out vec3 ourBase;
+#endif
+#if CLIPMAP_HOLE
+out vec3 holePos;
+#endif
 
 void main()
 {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
-    vec3 ourMainDirection = (view * vec4(mainDirection, 1.0)).rgb;
     ourTexCoord = aTexCoord;
+#if CLIPMAP_HOLE
+    holePos = (model * vec4(aPos, 1.0)).xyz;
+#endif
+    vec4 color = tint;
+#if OCCLUSION
+    color.rgb *= aOcclusion;
+#endif
 
-    mat4 modelView  = view * model;
-    mat4 modelViewIt = transpose(inverse(modelView));
-    vec3 normal = normalize((modelViewIt * vec4(0, 0, 1, 1)).xyz);
-    ourColor.a = tint.a;
-    ourColor.rgb = tint.rgb * ambientColor + clamp((tint.rgb * mainColor * dot(ourMainDirection, normal)).xyz, 0, 1);
-}
\ No newline at end of file
+#if DEFERRED
+    normal = normalize(normalMatrix * aNormal);
+    ourColor = color;
+#else
+    // Same light as relief.frag, per vertex
+    vec3 lightPos = normalize(mat3(view) * -lightSource.xyz);
+#if LIGHT_VOLUME
+    worldPos = (model * vec4(aPos, 1.0)).xyz;
+    worldNormal = mat3(model) * aNormal;
+    ourBase = color.rgb;
+#endif
+    vec3 normal = normalize(normalMatrix * aNormal);
+    vec3 light = clamp(color.rgb * lightColor.rgb * dot(lightPos, normal), 0, 1) * diffuse;
+    ourColor.a = color.a;
+#if SHADOWS
+    pos = (view * model * vec4(aPos, 1.0)).xyz;
+    ourColor.rgb = color.rgb * ambient;
+    ourLight = light;
+#else
+    ourColor.rgb = color.rgb * ambient + light;
+#endif
+#endif
+}
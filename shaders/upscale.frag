@@ -0,0 +1,12 @@
+#version 330 core
+in vec2 ourTexCoord;
+
+// The scene at the scaled resolution, sampled bilinearly
+uniform sampler2D sceneTex;
+
+out vec4 fragColor;
+
+void main()
+{
+    fragColor = vec4(texture(sceneTex, ourTexCoord).rgb, 1);
+}
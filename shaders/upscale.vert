@@ -0,0 +1,10 @@
+#version 330 core
+out vec2 ourTexCoord;
+
+// A triangle covering the screen, no vertex buffer needed
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    ourTexCoord = corner;
+    gl_Position = vec4(corner * 2 - 1, 0, 1);
+}
@@ -5,6 +5,8 @@
 constexpr int CHUNK_SIDE       = 256;
 constexpr int CHUNK_LOAD_DELTA = 32;
 constexpr int CHUNK_HALF_SIDE  = CHUNK_SIDE / 2;
+/// Coarser chunks around the first, each with cells twice the side of the last
+constexpr unsigned CLIPMAP_LEVELS = 3;
 
 class Chunk
 {
@@ -0,0 +1,75 @@
+#include "ChunkPyramid.hpp"
+
+using namespace std;
+
+/// The cells below a cell, relative to twice its position
+static const glm::ivec3 children[] = {{0, 0, 0},
+                                      {1, 0, 0},
+                                      {0, 1, 0},
+                                      {1, 1, 0},
+                                      {0, 0, 1},
+                                      {1, 0, 1},
+                                      {0, 1, 1},
+                                      {1, 1, 1}};
+
+ChunkPyramid::ChunkPyramid(const Chunk& chunk)
+  : mChunk(chunk)
+{
+  for (unsigned level = 1; level <= PYRAMID_LEVELS; ++level) {
+    size_t side = CHUNK_SIDE >> level;
+    mLevels[level - 1].resize(side * side * side, NO_BLOCK);
+  }
+}
+
+void
+ChunkPyramid::update(const DirtyRegion& region)
+{
+  for (unsigned level = 1; level <= PYRAMID_LEVELS; ++level) {
+    // Floor division, regions may be at negative coordinates
+    glm::ivec3 lowerCell(region.lowerBound.x >> level,
+                         region.lowerBound.y >> level,
+                         region.lowerBound.z >> level);
+    glm::ivec3 higherCell(((region.higherBound.x - 1) >> level) + 1,
+                          ((region.higherBound.y - 1) >> level) + 1,
+                          ((region.higherBound.z - 1) >> level) + 1);
+    glm::ivec3 cell;
+    for (cell.z = lowerCell.z; cell.z < higherCell.z; ++cell.z) {
+      for (cell.y = lowerCell.y; cell.y < higherCell.y; ++cell.y) {
+        for (cell.x = lowerCell.x; cell.x < higherCell.x; ++cell.x) {
+          unsigned types[8];
+          unsigned counts[8];
+          unsigned typeCount = 0;
+          unsigned solid     = 0;
+          for (auto& child : children) {
+            auto blockType = at(level - 1, cell * 2 + child);
+            if (blockType == NO_BLOCK) {
+              continue;
+            }
+            ++solid;
+            unsigned i = 0;
+            while (i < typeCount && types[i] != blockType) {
+              ++i;
+            }
+            if (i == typeCount) {
+              types[typeCount]  = blockType;
+              counts[typeCount] = 0;
+              ++typeCount;
+            }
+            ++counts[i];
+          }
+          unsigned blockType = NO_BLOCK;
+          if (solid >= 4) {
+            unsigned best = 0;
+            for (unsigned i = 1; i < typeCount; ++i) {
+              if (counts[i] > counts[best]) {
+                best = i;
+              }
+            }
+            blockType = types[best];
+          }
+          mLevels[level - 1][mIndex(level, cell)] = blockType;
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "Chunk.hpp"
+#include "DirtyRegion.hpp"
+
+/// Downsampled levels above the chunk, each cell twice the side of the last
+constexpr unsigned PYRAMID_LEVELS = 3;
+/// Side of the cells of the coarsest level, in voxels
+constexpr int PYRAMID_CELL_SIDE = 1 << PYRAMID_LEVELS;
+
+/**
+ * @brief Mip chain of the chunk, with cells of 2, 4 and 8 voxels
+ *
+ * Each cell stands for the 8 cells below it: it holds their most common block
+ * type when at least half of them are not empty, and NO_BLOCK otherwise. As
+ * levels are built one from another, one voxel thick walls survive all of
+ * them. Cells are aligned to world coordinates and wrap like Chunk::at(), so a
+ * cell never changes while the camera moves.
+ */
+class ChunkPyramid
+{
+public:
+  ChunkPyramid(const Chunk& chunk);
+
+  /**
+   * @brief Recompute the cells covering the region, from the chunk up
+   *
+   */
+  void update(const DirtyRegion& region);
+
+  /**
+   * @brief The block type of a cell
+   *
+   * @param level 0 for the chunk itself, up to PYRAMID_LEVELS
+   * @param cell the cell position, the world position divided by its side
+   */
+  unsigned at(unsigned level, const glm::ivec3& cell) const
+  {
+    if (level == 0) {
+      return mChunk.at(cell).blockType;
+    }
+    return mLevels[level - 1][mIndex(level, cell)];
+  }
+
+private:
+  static size_t mIndex(unsigned level, const glm::ivec3& cell)
+  {
+    int side = CHUNK_SIDE >> level;
+    int mask = side - 1;
+    return (size_t(cell.z & mask) * side + (cell.y & mask)) * side +
+           (cell.x & mask);
+  }
+
+private:
+  const Chunk&          mChunk;
+  std::vector<unsigned> mLevels[PYRAMID_LEVELS];
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <functional>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * @brief An axis aligned box of voxels whose content has changed
+ *
+ * The range is [lowerBound, higherBound), inclusive, exclusive, in world voxel
+ * coordinates (not chunk indexes).
+ */
+struct DirtyRegion
+{
+  glm::ivec3 lowerBound;
+  glm::ivec3 higherBound;
+
+  bool contains(const glm::ivec3& pos) const
+  {
+    return pos.x >= lowerBound.x && pos.x < higherBound.x &&
+           pos.y >= lowerBound.y && pos.y < higherBound.y &&
+           pos.z >= lowerBound.z && pos.z < higherBound.z;
+  }
+
+  bool intersects(const DirtyRegion& other) const
+  {
+    return lowerBound.x < other.higherBound.x &&
+           other.lowerBound.x < higherBound.x &&
+           lowerBound.y < other.higherBound.y &&
+           other.lowerBound.y < higherBound.y &&
+           lowerBound.z < other.higherBound.z &&
+           other.lowerBound.z < higherBound.z;
+  }
+};
+
+/**
+ * @brief Callback to be notified when a region changes
+ *
+ * It is called synchronously, right after the voxels were written, so the
+ * listener can update its derived data in the same frame.
+ */
+using DirtyRegionListener = std::function<void(const DirtyRegion& region)>;
+
+/**
+ * @brief Dispatches dirty regions to its subscribers
+ *
+ */
+class DirtyRegionPublisher
+{
+public:
+  /**
+   * @brief Register a listener
+   *
+   * @param listener the callback
+   * @return unsigned an id to be used on unsubscribe()
+   */
+  unsigned subscribe(DirtyRegionListener listener)
+  {
+    mListeners.emplace_back(mNextId, std::move(listener));
+    return mNextId++;
+  }
+
+  void unsubscribe(unsigned id)
+  {
+    for (auto it = mListeners.begin(); it != mListeners.end(); ++it) {
+      if (it->first == id) {
+        mListeners.erase(it);
+        return;
+      }
+    }
+  }
+
+  void publish(const DirtyRegion& region) const
+  {
+    for (auto&& listener : mListeners) {
+      listener.second(region);
+    }
+  }
+
+private:
+  std::vector<std::pair<unsigned, DirtyRegionListener>> mListeners;
+  unsigned                                              mNextId = 1;
+};
@@ -0,0 +1,124 @@
+#include "FrameBuffer.hpp"
+#include <stdexcept>
+#include <GL/glew.h>
+
+using namespace std;
+
+FrameBuffer::FrameBuffer(int              width,
+                         int              height,
+                         vector<unsigned> colorFormats,
+                         bool             depth)
+  : mColorFormats(move(colorFormats))
+  , mHasDepth(depth)
+  , mWidth(width)
+  , mHeight(height)
+{
+  glGenFramebuffers(1, &mFrameBufferId);
+  mCreateAttachments();
+}
+
+FrameBuffer::~FrameBuffer()
+{
+  mDeleteAttachments();
+  glDeleteFramebuffers(1, &mFrameBufferId);
+}
+
+void
+FrameBuffer::bind() const
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, mFrameBufferId);
+  glViewport(0, 0, mWidth, mHeight);
+}
+
+void
+FrameBuffer::unbind()
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void
+FrameBuffer::resize(int width, int height)
+{
+  if (width == mWidth && height == mHeight) {
+    return;
+  }
+  mWidth  = width;
+  mHeight = height;
+  mDeleteAttachments();
+  mCreateAttachments();
+}
+
+/**
+ * @brief Create a texture sampled 1:1, so no filtering nor mipmaps
+ *
+ */
+static unsigned
+createTarget(unsigned internalFormat,
+             unsigned format,
+             unsigned type,
+             int      width,
+             int      height)
+{
+  unsigned texture;
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D,
+               0,
+               internalFormat,
+               width,
+               height,
+               0,
+               format,
+               type,
+               nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  return texture;
+}
+
+void
+FrameBuffer::mCreateAttachments()
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, mFrameBufferId);
+  vector<GLenum> drawBuffers;
+  for (auto format : mColorFormats) {
+    auto attachment = GL_COLOR_ATTACHMENT0 + mColorTextures.size();
+    auto texture    = createTarget(format, GL_RGBA, GL_FLOAT, mWidth, mHeight);
+    glFramebufferTexture2D(
+      GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+    mColorTextures.push_back(texture);
+    drawBuffers.push_back(attachment);
+  }
+  if (mHasDepth) {
+    mDepthTexture = createTarget(GL_DEPTH_COMPONENT24,
+                                 GL_DEPTH_COMPONENT,
+                                 GL_FLOAT,
+                                 mWidth,
+                                 mHeight);
+    glFramebufferTexture2D(
+      GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepthTexture, 0);
+  }
+  if (drawBuffers.empty()) {
+    glDrawBuffer(GL_NONE);
+  } else {
+    glDrawBuffers(drawBuffers.size(), drawBuffers.data());
+  }
+  auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    throw runtime_error("Incomplete framebuffer " + to_string(status));
+  }
+}
+
+void
+FrameBuffer::mDeleteAttachments()
+{
+  glDeleteTextures(mColorTextures.size(), mColorTextures.data());
+  mColorTextures.clear();
+  if (mDepthTexture) {
+    glDeleteTextures(1, &mDepthTexture);
+    mDepthTexture = 0;
+  }
+}
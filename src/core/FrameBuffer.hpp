@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+
+/**
+ * @brief An offscreen render target made of textures
+ *
+ */
+class FrameBuffer
+{
+public:
+  /**
+   * @brief Construct a new Frame Buffer
+   *
+   * @param width the width in pixels
+   * @param height the height in pixels
+   * @param colorFormats the internal format of each color attachment, in
+   * attachment order
+   * @param depth if true, a depth texture is attached too
+   */
+  FrameBuffer(int                   width,
+              int                   height,
+              std::vector<unsigned> colorFormats,
+              bool                  depth = true);
+  ~FrameBuffer();
+  FrameBuffer(const FrameBuffer&) = delete;
+  FrameBuffer(FrameBuffer&&)      = delete;
+  FrameBuffer& operator=(const FrameBuffer&) = delete;
+  FrameBuffer& operator=(FrameBuffer&&) = delete;
+
+  /**
+   * @brief Draw into all color attachments, and set the viewport to cover it
+   *
+   */
+  void bind() const;
+
+  /**
+   * @brief Go back to the window framebuffer
+   *
+   */
+  static void unbind();
+
+  /**
+   * @brief Recreate the attachments with a new size, their content is lost
+   *
+   */
+  void resize(int width, int height);
+
+  unsigned colorTexture(unsigned index) const { return mColorTextures[index]; }
+  unsigned depthTexture() const { return mDepthTexture; }
+  int      width() const { return mWidth; }
+  int      height() const { return mHeight; }
+
+private:
+  void mCreateAttachments();
+  void mDeleteAttachments();
+
+private:
+  unsigned              mFrameBufferId;
+  std::vector<unsigned> mColorFormats;
+  std::vector<unsigned> mColorTextures;
+  unsigned              mDepthTexture = 0;
+  bool                  mHasDepth;
+  int                   mWidth;
+  int                   mHeight;
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A generational reference into a HandleTable
+ *
+ * The low bits are the slot index and the high bits the slot generation, so a
+ * handle to a released slot is detected instead of aliasing whatever took its
+ * place. The default (zero) handle is never valid.
+ *
+ * @tparam TAG the kind of resource it refers to
+ */
+template<class TAG>
+struct Handle
+{
+  static constexpr unsigned INDEX_BITS = 20;
+  static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+
+  uint32_t value = 0;
+
+  uint32_t index() const { return value & INDEX_MASK; }
+  uint32_t generation() const { return value >> INDEX_BITS; }
+
+  explicit operator bool() const { return value != 0; }
+  bool     operator==(Handle rhs) const { return value == rhs.value; }
+  bool     operator!=(Handle rhs) const { return value != rhs.value; }
+};
+
+/**
+ * @brief Dense storage addressed by Handle
+ *
+ * @tparam T the stored value
+ * @tparam TAG the handle tag, T by default
+ */
+template<class T, class TAG = T>
+class HandleTable
+{
+public:
+  using HandleType = Handle<TAG>;
+
+  HandleType insert(T value)
+  {
+    uint32_t index;
+    if (mFreeSlots.empty()) {
+      index = mSlots.size();
+      mSlots.emplace_back();
+    } else {
+      index = mFreeSlots.back();
+      mFreeSlots.pop_back();
+    }
+    auto& slot = mSlots[index];
+    slot.value = std::move(value);
+    slot.used  = true;
+    return {slot.generation << HandleType::INDEX_BITS | index};
+  }
+
+  void erase(HandleType handle)
+  {
+    if (!get(handle)) {
+      return;
+    }
+    auto& slot = mSlots[handle.index()];
+    slot.value = T{};
+    slot.used  = false;
+    // Wraps skipping 0, which would make a zero handle valid
+    if (++slot.generation >> (32 - HandleType::INDEX_BITS)) {
+      slot.generation = 1;
+    }
+    mFreeSlots.push_back(handle.index());
+  }
+
+  /**
+   * @brief Get the value
+   *
+   * @return T* the value or nullptr if the handle is stale or invalid
+   */
+  T* get(HandleType handle)
+  {
+    auto index = handle.index();
+    if (index >= mSlots.size()) {
+      return nullptr;
+    }
+    auto& slot = mSlots[index];
+    if (!slot.used || slot.generation != handle.generation()) {
+      return nullptr;
+    }
+    return &slot.value;
+  }
+
+  const T* get(HandleType handle) const
+  {
+    return const_cast<HandleTable*>(this)->get(handle);
+  }
+
+  template<class CALLBACK>
+  void forEach(CALLBACK callback)
+  {
+    for (uint32_t i = 0; i < mSlots.size(); ++i) {
+      auto& slot = mSlots[i];
+      if (slot.used) {
+        callback(HandleType{slot.generation << HandleType::INDEX_BITS | i},
+                 slot.value);
+      }
+    }
+  }
+
+private:
+  struct Slot
+  {
+    T        value{};
+    uint32_t generation = 1;
+    bool     used       = false;
+  };
+
+  std::vector<Slot>     mSlots;
+  std::vector<uint32_t> mFreeSlots;
+};
@@ -0,0 +1,230 @@
+#include "LightClusters.hpp"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <GL/glew.h>
+
+using namespace std;
+
+/// Lights per job, so a few lights do not pay for waking workers
+constexpr unsigned MIN_JOB_LIGHTS = 16;
+
+LightClusters::LightClusters()
+{
+  unsigned jobs = clamp(thread::hardware_concurrency(), 1u, 4u);
+  mJobIndices.resize(jobs);
+  for (unsigned i = 1; i < jobs; ++i) {
+    mWorkers.emplace_back([this] { mWork(); });
+  }
+}
+
+LightClusters::~LightClusters()
+{
+  {
+    lock_guard<mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mJobAvailable.notify_all();
+  for (auto& worker : mWorkers) {
+    worker.join();
+  }
+  glDeleteTextures(3, mTextures);
+  glDeleteBuffers(3, mBuffers);
+}
+
+void
+LightClusters::update(const vector<PointLight>& lights,
+                      const glm::mat4&          view,
+                      float                     fov,
+                      float                     ratio,
+                      float                     near,
+                      float                     far)
+{
+  mNear        = near;
+  mFar         = far;
+  mTanHalfFovY = tan(fov / 2);
+  mTanHalfFovX = mTanHalfFovY * ratio;
+  mLightData.clear();
+  for (auto& light : lights) {
+    auto position = view * glm::vec4(light.position, 1);
+    mLightData.emplace_back(glm::vec3(position), light.radius);
+    mLightData.emplace_back(light.color, 0);
+  }
+
+  unsigned jobs = mJobIndices.size();
+  jobs          = clamp(unsigned(lights.size() / MIN_JOB_LIGHTS), 1u, jobs);
+  mJobSlices    = (CLUSTER_SLICES + jobs - 1) / jobs;
+
+  // The first range runs here, each job fills its own index list
+  {
+    lock_guard<mutex> lock(mMutex);
+    mJobCount    = jobs;
+    mNextJob     = 1;
+    mPendingJobs = jobs - 1;
+  }
+  mJobAvailable.notify_all();
+  mAssignJob(0);
+  {
+    unique_lock<mutex> lock(mMutex);
+    mJobDone.wait(lock, [this] { return mPendingJobs == 0; });
+  }
+
+  // Copied, so every list keeps its capacity for the next frame
+  mIndices.assign(mJobIndices[0].begin(), mJobIndices[0].end());
+  for (unsigned job = 1; job < jobs; ++job) {
+    unsigned offset = mIndices.size();
+    unsigned begin  = job * mJobSlices * CLUSTER_COLUMNS * CLUSTER_ROWS;
+    unsigned end    = min((job + 1) * mJobSlices, CLUSTER_SLICES) *
+                   CLUSTER_COLUMNS * CLUSTER_ROWS;
+    for (unsigned cluster = begin; cluster < end; ++cluster) {
+      mGrid[cluster].x += offset;
+    }
+    mIndices.insert(
+      mIndices.end(), mJobIndices[job].begin(), mJobIndices[job].end());
+  }
+}
+
+void
+LightClusters::mAssignJob(unsigned job)
+{
+  mJobIndices[job].clear();
+  mAssignSlices(job * mJobSlices,
+                min((job + 1) * mJobSlices, CLUSTER_SLICES),
+                mJobIndices[job]);
+}
+
+void
+LightClusters::mWork()
+{
+  for (;;) {
+    unsigned job;
+    {
+      unique_lock<mutex> lock(mMutex);
+      mJobAvailable.wait(lock,
+                         [this] { return mStopping || mNextJob < mJobCount; });
+      if (mStopping) {
+        return;
+      }
+      job = mNextJob++;
+    }
+    mAssignJob(job);
+    {
+      lock_guard<mutex> lock(mMutex);
+      --mPendingJobs;
+    }
+    mJobDone.notify_one();
+  }
+}
+
+/**
+ * @brief The tile containing a view space slope (x/depth), clamped to the grid
+ *
+ */
+static int
+tileOf(float slope, float tanHalfFov, unsigned tiles)
+{
+  float tile = (slope / tanHalfFov * .5f + .5f) * tiles;
+  return clamp(int(floor(tile)), 0, int(tiles) - 1);
+}
+
+void
+LightClusters::mAssignSlices(unsigned          begin,
+                             unsigned          end,
+                             vector<unsigned>& indices)
+{
+  struct TileRange
+  {
+    unsigned light;
+    int      minColumn, maxColumn;
+    int      minRow, maxRow;
+  };
+  vector<TileRange> sliceLights;
+  float             depthRatio = mFar / mNear;
+  for (unsigned slice = begin; slice < end; ++slice) {
+    float sliceNear = mNear * pow(depthRatio, float(slice) / CLUSTER_SLICES);
+    float sliceFar =
+      mNear * pow(depthRatio, float(slice + 1) / CLUSTER_SLICES);
+
+    // The box around each sphere, over the slice depth it spans
+    sliceLights.clear();
+    for (unsigned light = 0; light < mLightData.size() / 2; ++light) {
+      auto& sphere = mLightData[light * 2];
+      float depth  = -sphere.z;
+      float near   = max(depth - sphere.w, sliceNear);
+      float far    = min(depth + sphere.w, sliceFar);
+      if (near > far) {
+        continue;
+      }
+      float left   = sphere.x - sphere.w;
+      float right  = sphere.x + sphere.w;
+      float bottom = sphere.y - sphere.w;
+      float top    = sphere.y + sphere.w;
+      float minX   = min(left / near, left / far);
+      float maxX   = max(right / near, right / far);
+      float minY   = min(bottom / near, bottom / far);
+      float maxY   = max(top / near, top / far);
+      if (minX > mTanHalfFovX || maxX < -mTanHalfFovX ||
+          minY > mTanHalfFovY || maxY < -mTanHalfFovY) {
+        continue;
+      }
+      sliceLights.push_back({light,
+                             tileOf(minX, mTanHalfFovX, CLUSTER_COLUMNS),
+                             tileOf(maxX, mTanHalfFovX, CLUSTER_COLUMNS),
+                             tileOf(minY, mTanHalfFovY, CLUSTER_ROWS),
+                             tileOf(maxY, mTanHalfFovY, CLUSTER_ROWS)});
+    }
+
+    for (int row = 0; row < int(CLUSTER_ROWS); ++row) {
+      for (int column = 0; column < int(CLUSTER_COLUMNS); ++column) {
+        auto& cell = mGrid[(slice * CLUSTER_ROWS + row) * CLUSTER_COLUMNS +
+                           column];
+        cell.x     = indices.size();
+        for (auto& range : sliceLights) {
+          if (column >= range.minColumn && column <= range.maxColumn &&
+              row >= range.minRow && row <= range.maxRow) {
+            indices.push_back(range.light);
+            if (indices.size() - cell.x == MAX_CLUSTER_LIGHTS) {
+              break;
+            }
+          }
+        }
+        cell.y = indices.size() - cell.x;
+      }
+    }
+  }
+}
+
+void
+LightClusters::upload()
+{
+  static const GLenum formats[] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+  if (!mBuffers[0]) {
+    glGenBuffers(3, mBuffers);
+    glGenTextures(3, mTextures);
+  }
+  // Empty buffers can not back a texture, so there is always one element
+  glm::vec4   noLight(0);
+  unsigned    noIndex = 0;
+  const void* data[]  = {mLightData.empty() ? &noLight : mLightData.data(),
+                         mGrid.data(),
+                         mIndices.empty() ? &noIndex : mIndices.data()};
+  size_t      sizes[] = {max(mLightData.size(), size_t(1)) * sizeof(glm::vec4),
+                         mGrid.size() * sizeof(glm::uvec2),
+                         max(mIndices.size(), size_t(1)) * sizeof(unsigned)};
+  for (unsigned i = 0; i < 3; ++i) {
+    glBindBuffer(GL_TEXTURE_BUFFER, mBuffers[i]);
+    glBufferData(GL_TEXTURE_BUFFER, sizes[i], data[i], GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[i], mBuffers[i]);
+  }
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void
+LightClusters::bind(unsigned firstUnit) const
+{
+  for (unsigned i = 0; i < 3; ++i) {
+    glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+    glBindTexture(GL_TEXTURE_BUFFER, mTextures[i]);
+  }
+}
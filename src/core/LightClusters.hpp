@@ -0,0 +1,121 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+ * @brief A light radiating from a point, fading to nothing at radius
+ *
+ */
+struct PointLight
+{
+  glm::vec3 position;
+  float     radius = 4.f;
+  glm::vec3 color{1.f};
+};
+
+/// The view frustum is split in CLUSTER_COLUMNS x CLUSTER_ROWS tiles
+constexpr unsigned CLUSTER_COLUMNS = 16;
+constexpr unsigned CLUSTER_ROWS    = 9;
+/// Depth slices, exponentially spaced from near to far
+constexpr unsigned CLUSTER_SLICES = 24;
+constexpr unsigned CLUSTER_COUNT =
+  CLUSTER_COLUMNS * CLUSTER_ROWS * CLUSTER_SLICES;
+/// Lights past this in a single cluster are dropped, bounding fragment cost
+constexpr unsigned MAX_CLUSTER_LIGHTS = 32;
+
+/**
+ * @brief Assigns point lights to the froxels (frustum voxels) they touch
+ *
+ * The assignment runs on the CPU each frame, the depth slices split among
+ * worker threads that live as long as the object. The result is uploaded to texture buffers, so a shader looks
+ * up its cluster and only iterates the lights affecting it:
+ * - lightData: two RGBA32F texels per light, view space position and radius,
+ *   then color;
+ * - lightGrid: one RG32UI texel per cluster, offset and count in lightIndices;
+ * - lightIndices: R32UI light indexes.
+ */
+class LightClusters
+{
+public:
+  LightClusters();
+  ~LightClusters();
+  LightClusters(const LightClusters&) = delete;
+  LightClusters(LightClusters&&)      = delete;
+  LightClusters& operator=(const LightClusters&) = delete;
+  LightClusters& operator=(LightClusters&&) = delete;
+
+  /**
+   * @brief Assign the lights to the clusters of the given frustum
+   *
+   * @param lights the lights, in world coordinates
+   * @param view the view matrix
+   * @param fov the vertical field of view, in radians
+   * @param ratio the width / height ratio
+   * @param near the near plane distance
+   * @param far the far plane distance
+   */
+  void update(const std::vector<PointLight>& lights,
+              const glm::mat4&               view,
+              float                          fov,
+              float                          ratio,
+              float                          near,
+              float                          far);
+
+  /**
+   * @brief Upload the last update() to the texture buffers
+   *
+   * Must be called from the render thread.
+   */
+  void upload();
+
+  /**
+   * @brief Bind lightData, lightGrid and lightIndices to consecutive units
+   *
+   * @param firstUnit the texture unit of lightData
+   */
+  void bind(unsigned firstUnit) const;
+
+  float near() const { return mNear; }
+  float far() const { return mFar; }
+
+  /// Light references over all clusters, after the MAX_CLUSTER_LIGHTS cap
+  unsigned assignedLights() const { return mIndices.size(); }
+
+private:
+  /**
+   * @brief Assign the slices [begin, end), appending to indices
+   *
+   * Grid offsets are relative to the indices start.
+   */
+  void mAssignSlices(unsigned               begin,
+                     unsigned               end,
+                     std::vector<unsigned>& indices);
+  void mAssignJob(unsigned job);
+  void mWork();
+
+private:
+  /// View space position and radius, then color, per light
+  std::vector<glm::vec4>  mLightData;
+  std::vector<glm::uvec2> mGrid = std::vector<glm::uvec2>(CLUSTER_COUNT);
+  std::vector<unsigned>   mIndices;
+  float                   mNear;
+  float                   mFar;
+  float                   mTanHalfFovX;
+  float                   mTanHalfFovY;
+  unsigned                mBuffers[3]  = {};
+  unsigned                mTextures[3] = {};
+  /// Jobs of the current update(), job 0 runs on the calling thread
+  std::vector<std::thread>           mWorkers;
+  std::mutex                         mMutex;
+  std::condition_variable            mJobAvailable;
+  std::condition_variable            mJobDone;
+  std::vector<std::vector<unsigned>> mJobIndices;
+  unsigned                           mJobSlices   = 0;
+  unsigned                           mJobCount    = 0;
+  unsigned                           mNextJob     = 0;
+  unsigned                           mPendingJobs = 0;
+  bool                               mStopping    = false;
+};
@@ -0,0 +1,412 @@
+#include "LightVolumeComponent.hpp"
+#include <algorithm>
+#include <GL/glew.h>
+#include "Camera.hpp"
+#include "LoaderComponent.hpp"
+#include "SceneDetail.hpp"
+#include "VoxelType.hpp"
+
+using namespace std;
+
+/// Set in mBlocks for voxels light can not go through
+constexpr uint8_t OPAQUE_BLOCK = 0x80;
+/// The rest of mBlocks is the block light emitted
+constexpr uint8_t EMISSION_MASK = 0x0f;
+
+constexpr unsigned SKY_SHIFT   = 4;
+constexpr unsigned BLOCK_SHIFT = 0;
+
+/// The six neighbours, the last one is below
+static const glm::ivec3 neighbours[] = {
+  {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, 1}, {0, 0, -1}};
+constexpr unsigned DOWN = 5;
+
+/**
+ * @brief The index of a voxel in the volume, wrapping like Chunk::at()
+ *
+ */
+inline size_t
+volumeIndex(const glm::ivec3& pos)
+{
+  return size_t(pos.z & (CHUNK_SIDE - 1)) * CHUNK_SIDE * CHUNK_SIDE +
+         size_t(pos.y & (CHUNK_SIDE - 1)) * CHUNK_SIDE +
+         size_t(pos.x & (CHUNK_SIDE - 1));
+}
+
+LightVolumeComponent::LightVolumeComponent()
+  : mLight(size_t(CHUNK_SIDE) * CHUNK_SIDE * CHUNK_SIDE)
+  , mBlocks(mLight.size())
+{
+  mChannels[0].shift = SKY_SHIFT;
+  mChannels[1].shift = BLOCK_SHIFT;
+}
+
+LightVolumeComponent::~LightVolumeComponent()
+{
+  mJoin();
+  if (mTexture) {
+    glDeleteTextures(1, &mTexture);
+  }
+}
+
+void
+LightVolumeComponent::onAttach(SceneDetail* scene)
+{
+  mSubscription = scene->subscribeDirty(
+    [this](const DirtyRegion& region) { mNewRegions.push_back(region); });
+}
+
+void
+LightVolumeComponent::onDetach(SceneDetail* scene)
+{
+  mJoin();
+  scene->unsubscribeDirty(mSubscription);
+}
+
+unsigned
+LightVolumeComponent::insertVoxelType(const VoxelType& type)
+{
+  mEmission.push_back(min(type.emission, MAX_LIGHT_LEVEL));
+  return mEmission.size();
+}
+
+void
+LightVolumeComponent::onUpdate(float delta)
+{
+  mJoin();
+  mUpload();
+
+  // The worker is stopped, so it is safe to hand it the new content
+  auto& chunk = scene()->chunk;
+  for (auto& region : mNewRegions) {
+    glm::ivec3 pos;
+    for (pos.z = region.lowerBound.z; pos.z < region.higherBound.z; ++pos.z) {
+      for (pos.y = region.lowerBound.y; pos.y < region.higherBound.y;
+           ++pos.y) {
+        for (pos.x = region.lowerBound.x; pos.x < region.higherBound.x;
+             ++pos.x) {
+          auto    blockType = chunk.at(pos).blockType;
+          uint8_t block     = 0;
+          if (blockType != NO_BLOCK) {
+            block = OPAQUE_BLOCK;
+            if (blockType <= mEmission.size()) {
+              block |= mEmission[blockType - 1];
+            }
+          }
+          mBlocks[volumeIndex(pos)] = block;
+        }
+      }
+    }
+    mRegions.push_back(region);
+  }
+  mNewRegions.clear();
+  if (loader && loader->center - CHUNK_HALF_SIDE != mRingLowerBound) {
+    mShiftRing(loader->center - CHUNK_HALF_SIDE);
+  }
+
+  mPendingSteps = 0;
+  for (auto& channel : mChannels) {
+    mPendingSteps += channel.additions.size() + channel.removals.size();
+  }
+  for (auto& region : mRegions) {
+    auto size = region.higherBound - region.lowerBound;
+    mPendingSteps += size.x * size.y * size.z;
+  }
+  if (mPendingSteps) {
+    mJob = async(launch::async, [this] { mPropagate(stepsPerFrame); });
+  }
+}
+
+void
+LightVolumeComponent::bind(unsigned unit) const
+{
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_3D, mTexture);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void
+LightVolumeComponent::mJoin()
+{
+  if (mJob.valid()) {
+    mJob.get();
+  }
+}
+
+void
+LightVolumeComponent::mUpload()
+{
+  glActiveTexture(GL_TEXTURE0 + LIGHT_VOLUME_UNIT);
+  if (!mTexture) {
+    glGenTextures(1, &mTexture);
+    glBindTexture(GL_TEXTURE_3D, mTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_3D,
+                 0,
+                 GL_R8UI,
+                 CHUNK_SIDE,
+                 CHUNK_SIDE,
+                 CHUNK_SIDE,
+                 0,
+                 GL_RED_INTEGER,
+                 GL_UNSIGNED_BYTE,
+                 mLight.data());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    fill_n(&mTouched[0][0][0], TILES * TILES * TILES, false);
+    glActiveTexture(GL_TEXTURE0);
+    return;
+  }
+
+  glBindTexture(GL_TEXTURE_3D, mTexture);
+  // Tiles are boxes inside the whole volume
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, CHUNK_SIDE);
+  glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, CHUNK_SIDE);
+  glm::ivec3 tile;
+  for (tile.z = 0; tile.z < TILES; ++tile.z) {
+    for (tile.y = 0; tile.y < TILES; ++tile.y) {
+      for (tile.x = 0; tile.x < TILES; ++tile.x) {
+        auto& touched = mTouched[tile.z][tile.y][tile.x];
+        if (!touched) {
+          continue;
+        }
+        auto lowerBound = tile * CHUNK_LOAD_DELTA;
+        glTexSubImage3D(GL_TEXTURE_3D,
+                        0,
+                        lowerBound.x,
+                        lowerBound.y,
+                        lowerBound.z,
+                        CHUNK_LOAD_DELTA,
+                        CHUNK_LOAD_DELTA,
+                        CHUNK_LOAD_DELTA,
+                        GL_RED_INTEGER,
+                        GL_UNSIGNED_BYTE,
+                        &mLight[volumeIndex(lowerBound)]);
+        touched = false;
+      }
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+  glActiveTexture(GL_TEXTURE0);
+}
+
+void
+LightVolumeComponent::mPropagate(unsigned steps)
+{
+  while (steps) {
+    // Removals first, so additions do not spread light about to go away
+    auto channel = find_if(begin(mChannels), end(mChannels), [](auto& c) {
+      return !c.removals.empty();
+    });
+    if (channel != end(mChannels)) {
+      auto removal = channel->removals.front();
+      channel->removals.pop();
+      mRemove(*channel, removal);
+      --steps;
+      continue;
+    }
+    channel = find_if(begin(mChannels), end(mChannels), [](auto& c) {
+      return !c.additions.empty();
+    });
+    if (channel != end(mChannels)) {
+      auto pos = channel->additions.front();
+      channel->additions.pop();
+      mAdd(*channel, pos);
+      --steps;
+      continue;
+    }
+    if (mRegions.empty()) {
+      return;
+    }
+    auto region = mRegions.back();
+    mRegions.pop_back();
+    mSeed(region);
+    auto size = region.higherBound - region.lowerBound;
+    steps -= min<unsigned>(steps, size.x * size.y * size.z);
+  }
+}
+
+void
+LightVolumeComponent::mSeed(const DirtyRegion& region)
+{
+  glm::ivec3 lowerBound = glm::max(region.lowerBound, mRingLowerBound);
+  glm::ivec3 higherBound =
+    glm::min(region.higherBound, mRingLowerBound + CHUNK_SIDE);
+  glm::ivec3 pos;
+  for (pos.z = lowerBound.z; pos.z < higherBound.z; ++pos.z) {
+    for (pos.y = lowerBound.y; pos.y < higherBound.y; ++pos.y) {
+      for (pos.x = lowerBound.x; pos.x < higherBound.x; ++pos.x) {
+        for (auto& channel : mChannels) {
+          unsigned level  = mLevel(channel, pos);
+          unsigned source = mSource(channel, pos);
+          mSetLevel(channel, pos, source);
+          if (level) {
+            channel.removals.push({pos, level});
+          }
+          if (source) {
+            channel.additions.push(pos);
+          }
+        }
+      }
+    }
+  }
+  // The light around flows back in
+  for (pos.z = lowerBound.z - 1; pos.z <= higherBound.z; ++pos.z) {
+    for (pos.y = lowerBound.y - 1; pos.y <= higherBound.y; ++pos.y) {
+      for (pos.x = lowerBound.x - 1; pos.x <= higherBound.x; ++pos.x) {
+        if (region.contains(pos) || !mInsideRing(pos)) {
+          continue;
+        }
+        for (auto& channel : mChannels) {
+          if (mLevel(channel, pos)) {
+            channel.additions.push(pos);
+          }
+        }
+      }
+    }
+  }
+}
+
+void
+LightVolumeComponent::mAdd(Channel& channel, const glm::ivec3& pos)
+{
+  if (!mInsideRing(pos)) {
+    return;
+  }
+  unsigned level = mLevel(channel, pos);
+  for (unsigned i = 0; i < 6; ++i) {
+    auto neighbour = pos + neighbours[i];
+    if (!mInsideRing(neighbour) ||
+        (mBlocks[volumeIndex(neighbour)] & OPAQUE_BLOCK)) {
+      continue;
+    }
+    // Sky light falls straight down without fading
+    unsigned spread = max(level, 1u) - 1;
+    if (channel.shift == SKY_SHIFT && i == DOWN && level == MAX_LIGHT_LEVEL) {
+      spread = level;
+    }
+    if (mLevel(channel, neighbour) < spread) {
+      mSetLevel(channel, neighbour, spread);
+      channel.additions.push(neighbour);
+    }
+  }
+}
+
+void
+LightVolumeComponent::mRemove(Channel& channel, const Removal& removal)
+{
+  if (!mInsideRing(removal.pos)) {
+    return;
+  }
+  for (unsigned i = 0; i < 6; ++i) {
+    auto neighbour = removal.pos + neighbours[i];
+    if (!mInsideRing(neighbour)) {
+      continue;
+    }
+    unsigned level = mLevel(channel, neighbour);
+    if (!level) {
+      continue;
+    }
+    bool litByRemoved = level < removal.level ||
+                        (channel.shift == SKY_SHIFT && i == DOWN &&
+                         removal.level == MAX_LIGHT_LEVEL);
+    if (!litByRemoved) {
+      // Lit from elsewhere, it fills the gap back
+      channel.additions.push(neighbour);
+      continue;
+    }
+    unsigned source = mSource(channel, neighbour);
+    mSetLevel(channel, neighbour, source);
+    channel.removals.push({neighbour, level});
+    if (source) {
+      channel.additions.push(neighbour);
+    }
+  }
+}
+
+unsigned
+LightVolumeComponent::mSource(const Channel&    channel,
+                              const glm::ivec3& pos) const
+{
+  auto block = mBlocks[volumeIndex(pos)];
+  if (channel.shift == BLOCK_SHIFT) {
+    return block & EMISSION_MASK;
+  }
+  // Open to the sky when nothing loaded is above
+  bool top = pos.z + 1 == mRingLowerBound.z + CHUNK_SIDE;
+  return top && !(block & OPAQUE_BLOCK) ? MAX_LIGHT_LEVEL : 0;
+}
+
+unsigned
+LightVolumeComponent::mLevel(const Channel&    channel,
+                             const glm::ivec3& pos) const
+{
+  return mLight[volumeIndex(pos)] >> channel.shift & MAX_LIGHT_LEVEL;
+}
+
+void
+LightVolumeComponent::mSetLevel(const Channel&    channel,
+                                const glm::ivec3& pos,
+                                unsigned          level)
+{
+  auto  mask  = MAX_LIGHT_LEVEL << channel.shift;
+  auto& light = mLight[volumeIndex(pos)];
+  light       = (light & ~mask) | level << channel.shift;
+  mTouched[(pos.z & (CHUNK_SIDE - 1)) / CHUNK_LOAD_DELTA]
+          [(pos.y & (CHUNK_SIDE - 1)) / CHUNK_LOAD_DELTA]
+          [(pos.x & (CHUNK_SIDE - 1)) / CHUNK_LOAD_DELTA] = true;
+}
+
+void
+LightVolumeComponent::mShiftRing(const glm::ivec3& ringLowerBound)
+{
+  // What enters holds the light of the other side of the ring, it goes dark
+  // until the loader fills it and publishes it
+  for (int axis = 0; axis < 3; ++axis) {
+    auto lowerBound  = ringLowerBound;
+    auto higherBound = ringLowerBound + CHUNK_SIDE;
+    int  shift       = ringLowerBound[axis] - mRingLowerBound[axis];
+    if (shift > 0) {
+      lowerBound[axis] = max(higherBound[axis] - shift, lowerBound[axis]);
+    } else if (shift < 0) {
+      higherBound[axis] = min(lowerBound[axis] - shift, higherBound[axis]);
+    } else {
+      continue;
+    }
+    glm::ivec3 pos;
+    for (pos.z = lowerBound.z; pos.z < higherBound.z; ++pos.z) {
+      for (pos.y = lowerBound.y; pos.y < higherBound.y; ++pos.y) {
+        for (pos.x = lowerBound.x; pos.x < higherBound.x; ++pos.x) {
+          for (auto& channel : mChannels) {
+            mSetLevel(channel, pos, 0);
+          }
+        }
+      }
+    }
+  }
+  // Sky light enters through the top layer, the old one and the new one
+  // change sources
+  if (ringLowerBound.z != mRingLowerBound.z) {
+    for (int top : {mRingLowerBound.z, ringLowerBound.z}) {
+      top += CHUNK_SIDE - 1;
+      mRegions.push_back({{ringLowerBound.x, ringLowerBound.y, top},
+                          {ringLowerBound.x + CHUNK_SIDE,
+                           ringLowerBound.y + CHUNK_SIDE,
+                           top + 1}});
+    }
+  }
+  mRingLowerBound = ringLowerBound;
+}
+
+bool
+LightVolumeComponent::mInsideRing(const glm::ivec3& pos) const
+{
+  auto offset = pos - mRingLowerBound;
+  return unsigned(offset.x) < unsigned(CHUNK_SIDE) &&
+         unsigned(offset.y) < unsigned(CHUNK_SIDE) &&
+         unsigned(offset.z) < unsigned(CHUNK_SIDE);
+}
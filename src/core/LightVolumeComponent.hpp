@@ -0,0 +1,118 @@
+#pragma once
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <queue>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Chunk.hpp"
+#include "DirtyRegion.hpp"
+#include "SceneComponent.hpp"
+
+class LoaderComponent;
+class VoxelType;
+
+/// Brightest level of both channels, they are 4 bits each
+constexpr unsigned MAX_LIGHT_LEVEL = 15;
+/// Texture unit of the light volume, after the shadow map
+constexpr unsigned LIGHT_VOLUME_UNIT = 7;
+
+/**
+ * @brief Sky and block light flood-filled through the chunk
+ *
+ * Each voxel packs two 4-bit levels, sky light in the high bits and block
+ * light in the low ones. Sky light enters through the open voxels on top of
+ * the ring and goes down undimmed, block light starts at emitting voxels.
+ * Both lose a level per voxel otherwise, and opaque voxels stop them.
+ *
+ * Dirty regions are relit incrementally with breadth first queues: the old
+ * light is removed and whatever still reaches the region spreads again. The
+ * queues run on a worker thread, up to stepsPerFrame voxels a frame, joined on
+ * the next update. Only then the worker sees the new dirty regions and the
+ * volume changed so far is uploaded, so neither side waits on the other.
+ */
+struct LightVolumeComponent : public SceneComponent
+{
+  /// Queued voxels visited per frame, spread over the frames after an edit
+  unsigned stepsPerFrame = 1 << 18;
+  /// The ring being lit is the one it keeps loaded, nothing is lit without it
+  std::shared_ptr<LoaderComponent> loader;
+
+  LightVolumeComponent();
+  ~LightVolumeComponent();
+
+  virtual void onUpdate(float delta) final;
+
+  /**
+   * @brief Register the light a block type emits, in the renderer order
+   *
+   * @return unsigned the blockType
+   */
+  unsigned insertVoxelType(const VoxelType& type);
+
+  /**
+   * @brief Bind the volume, an R8UI 3D texture indexed like the chunk
+   *
+   */
+  void bind(unsigned unit) const;
+
+  /// Voxels waiting in the queues and regions waiting to be seeded
+  unsigned pendingSteps() const { return mPendingSteps; }
+
+  /// The lowest voxel of the ring being lit, past the ring there is no volume
+  const glm::ivec3& ringLowerBound() const { return mRingLowerBound; }
+
+protected:
+  virtual void onAttach(SceneDetail* scene) final;
+  virtual void onDetach(SceneDetail* scene) final;
+
+private:
+  /// A voxel that lost its light, with the level it had
+  struct Removal
+  {
+    glm::ivec3 pos;
+    unsigned   level;
+  };
+
+  /// Queues of one channel, removals are drained before additions
+  struct Channel
+  {
+    unsigned               shift;
+    std::queue<glm::ivec3> additions;
+    std::queue<Removal>    removals;
+  };
+
+  void     mJoin();
+  void     mUpload();
+  void     mPropagate(unsigned steps);
+  void     mSeed(const DirtyRegion& region);
+  void     mAdd(Channel& channel, const glm::ivec3& pos);
+  void     mRemove(Channel& channel, const Removal& removal);
+  unsigned mSource(const Channel& channel, const glm::ivec3& pos) const;
+  unsigned mLevel(const Channel& channel, const glm::ivec3& pos) const;
+  void     mSetLevel(const Channel&    channel,
+                     const glm::ivec3& pos,
+                     unsigned          level);
+  void     mShiftRing(const glm::ivec3& ringLowerBound);
+  bool     mInsideRing(const glm::ivec3& pos) const;
+
+private:
+  /// The volume is uploaded by CHUNK_LOAD_DELTA tiles, the ones changed
+  static constexpr int TILES = CHUNK_SIDE / CHUNK_LOAD_DELTA;
+
+  // Owned by the worker while mJob runs
+  std::vector<uint8_t>     mLight;
+  std::vector<uint8_t>     mBlocks;
+  std::vector<DirtyRegion> mRegions;
+  Channel                  mChannels[2];
+  glm::ivec3               mRingLowerBound{0};
+  bool                     mTouched[TILES][TILES][TILES] = {};
+
+  // Owned by the main thread
+  std::vector<uint8_t>     mEmission;
+  std::vector<DirtyRegion> mNewRegions;
+  std::future<void>        mJob;
+  unsigned                 mPendingSteps = 0;
+  unsigned                 mTexture      = 0;
+  unsigned                 mSubscription = 0;
+};
@@ -1,7 +1,8 @@
 #include "LoaderComponent.hpp"
+#include <algorithm>
+#include <bitset>
 #include "Camera.hpp"
 #include "SceneDetail.hpp"
-#include "util/fastMath.hpp"
 
 using namespace std;
 
@@ -16,100 +17,35 @@ getAreaToReload(int offset)
   return areaToReload;
 }
 
-template<int axisI, int axisJ = (axisI + 1) % 3, int axisK = (axisI + 2) % 3>
-void
-checkAndRefreshChunk(Chunk*            chunk,
-                     SceneLoader&      generator,
-                     glm::ivec3&       center,
-                     const glm::ivec3& delta)
+inline int
+alignToTile(int value)
 {
-  if (delta[axisI] < -(CHUNK_HALF_SIDE - CHUNK_LOAD_DELTA)) {
-    int areaToReload = getAreaToReload(delta[axisI]);
-    center[axisI] -= areaToReload;
-    int        r = floorMod(center[axisJ] - CHUNK_HALF_SIDE, CHUNK_SIDE);
-    int        q = floorMod(center[axisK] - CHUNK_HALF_SIDE, CHUNK_SIDE);
-    glm::ivec3 lBound, hBound, offset;
-    lBound[axisI] = CHUNK_SIDE - areaToReload;
-    lBound[axisJ] = r;
-    lBound[axisK] = q;
-    hBound[axisI] = CHUNK_SIDE;
-    hBound[axisJ] = CHUNK_SIDE;
-    hBound[axisK] = CHUNK_SIDE;
-    offset[axisI] = center[axisI] - CHUNK_SIDE * 3 / 2 + areaToReload;
-    offset[axisJ] = center[axisJ] - CHUNK_HALF_SIDE - r;
-    offset[axisK] = center[axisK] - CHUNK_HALF_SIDE - q;
-    generator(lBound, hBound, offset, chunk);
-    if (r) {
-      lBound[axisJ] = 0;
-      lBound[axisK] = q;
-      hBound[axisJ] = r;
-      hBound[axisK] = CHUNK_SIDE;
-      offset[axisJ] = center[axisJ] + CHUNK_HALF_SIDE - r;
-      offset[axisK] = center[axisK] - CHUNK_HALF_SIDE - q;
-      generator(lBound, hBound, offset, chunk);
-    }
-    if (q) {
-      lBound[axisJ] = r;
-      lBound[axisK] = 0;
-      hBound[axisJ] = CHUNK_SIDE;
-      hBound[axisK] = q;
-      offset[axisJ] = center[axisJ] - CHUNK_HALF_SIDE - r;
-      offset[axisK] = center[axisK] + CHUNK_HALF_SIDE - q;
-      generator(lBound, hBound, offset, chunk);
-      if (r) {
-        lBound[axisJ] = 0;
-        lBound[axisK] = 0;
-        hBound[axisJ] = r;
-        hBound[axisK] = q;
-        offset[axisJ] = center[axisJ] + CHUNK_HALF_SIDE - r;
-        offset[axisK] = center[axisK] + CHUNK_HALF_SIDE - q;
-        generator(lBound, hBound, offset, chunk);
-      }
-    }
-  } else if (delta[axisI] >= (CHUNK_HALF_SIDE - CHUNK_LOAD_DELTA)) {
-    int areaToReload = getAreaToReload(delta[axisI]);
-    center[axisI] += areaToReload;
-    int        r = floorMod(center[axisJ] - CHUNK_HALF_SIDE, CHUNK_SIDE);
-    int        q = floorMod(center[axisK] - CHUNK_HALF_SIDE, CHUNK_SIDE);
-    glm::ivec3 lBound, hBound, offset;
-    lBound[axisI] = 0;
-    lBound[axisJ] = r;
-    lBound[axisK] = q;
-    hBound[axisI] = areaToReload;
-    hBound[axisJ] = CHUNK_SIDE;
-    hBound[axisK] = CHUNK_SIDE;
-    offset[axisI] = center[axisI] - CHUNK_HALF_SIDE + areaToReload;
-    offset[axisJ] = center[axisJ] - CHUNK_HALF_SIDE - r;
-    offset[axisK] = center[axisK] - CHUNK_HALF_SIDE - q;
-    generator(lBound, hBound, offset, chunk);
-    if (r) {
-      lBound[axisJ] = 0;
-      lBound[axisK] = q;
-      hBound[axisJ] = r;
-      hBound[axisK] = CHUNK_SIDE;
-      offset[axisJ] = center[axisJ] + CHUNK_HALF_SIDE - r;
-      offset[axisK] = center[axisK] - CHUNK_HALF_SIDE - q;
-      generator(lBound, hBound, offset, chunk);
-    }
-    if (q) {
-      lBound[axisJ] = r;
-      lBound[axisK] = 0;
-      hBound[axisJ] = CHUNK_SIDE;
-      hBound[axisK] = q;
-      offset[axisJ] = center[axisJ] - CHUNK_HALF_SIDE - r;
-      offset[axisK] = center[axisK] + CHUNK_HALF_SIDE - q;
-      generator(lBound, hBound, offset, chunk);
-      if (r) {
-        lBound[axisJ] = 0;
-        lBound[axisK] = 0;
-        hBound[axisJ] = r;
-        hBound[axisK] = q;
-        offset[axisJ] = center[axisJ] + CHUNK_HALF_SIDE - r;
-        offset[axisK] = center[axisK] + CHUNK_HALF_SIDE - q;
-        generator(lBound, hBound, offset, chunk);
-      }
+  return value & ~(CHUNK_LOAD_DELTA - 1);
+}
+
+/// Tiles along each side of the ring
+constexpr int RING_TILES = CHUNK_SIDE / CHUNK_LOAD_DELTA;
+
+/// The ring wraps like the chunk, so the tiles inside it get distinct slots
+inline int
+ringSlot(const glm::ivec3& tile)
+{
+  int x = (tile.x & (CHUNK_SIDE - 1)) / CHUNK_LOAD_DELTA;
+  int y = (tile.y & (CHUNK_SIDE - 1)) / CHUNK_LOAD_DELTA;
+  int z = (tile.z & (CHUNK_SIDE - 1)) / CHUNK_LOAD_DELTA;
+  return (z * RING_TILES + y) * RING_TILES + x;
+}
+
+inline bool
+isInsideRing(const glm::ivec3& tile, const glm::ivec3& center)
+{
+  for (int i = 0; i < 3; ++i) {
+    if (tile[i] < center[i] - CHUNK_HALF_SIDE ||
+        tile[i] + CHUNK_LOAD_DELTA > center[i] + CHUNK_HALF_SIDE) {
+      return false;
     }
   }
+  return true;
 }
 
 void
@@ -117,20 +53,135 @@ LoaderComponent::onUpdate(float delta)
 {
   if (!generator)
     return;
-  glm::ivec3 offset = glm::ivec3(scene()->camera->position()) - center;
-  auto&      chunk  = scene()->chunk;
-  checkAndRefreshChunk<0>(&chunk, generator, center, offset);
-  checkAndRefreshChunk<1>(&chunk, generator, center, offset);
-  checkAndRefreshChunk<2>(&chunk, generator, center, offset);
+  glm::ivec3 offset = glm::ivec3(mCameraCell()) - center;
+  mShiftRing(0, offset.x);
+  mShiftRing(1, offset.y);
+  mShiftRing(2, offset.z);
+  if (requests.empty()) {
+    return;
+  }
+  mPrioritize();
+  auto count = min<size_t>(tilesPerFrame, requests.size());
+  for (size_t i = 0; i < count; ++i) {
+    mGenerate(requests[i].lowerBound);
+  }
+  requests.erase(requests.begin(), requests.begin() + count);
 }
 
 void
 LoaderComponent::reset()
 {
+  requests.clear();
   if (!generator) {
     return;
   }
-  center = glm::ivec3(CHUNK_SIDE / 2);
-  generator(
-    glm::ivec3(0), glm::vec3(CHUNK_SIDE), glm::vec3(0), &scene()->chunk);
+  auto cameraPos = mCameraCell();
+  center         = glm::ivec3(alignToTile(int(floor(cameraPos.x))),
+                     alignToTile(int(floor(cameraPos.y))),
+                     alignToTile(int(floor(cameraPos.z))));
+  mEnqueue(center - CHUNK_HALF_SIDE, center + CHUNK_HALF_SIDE);
+}
+
+void
+LoaderComponent::flush()
+{
+  if (!generator) {
+    return;
+  }
+  mPrioritize();
+  for (auto& request : requests) {
+    mGenerate(request.lowerBound);
+  }
+  requests.clear();
+}
+
+glm::vec3
+LoaderComponent::mCameraCell() const
+{
+  return scene()->camera->position() / float(1 << level);
+}
+
+void
+LoaderComponent::mEnqueue(const glm::ivec3& lowerBound,
+                          const glm::ivec3& higherBound)
+{
+  glm::ivec3 lBound = glm::max(lowerBound, center - CHUNK_HALF_SIDE);
+  glm::ivec3 hBound = glm::min(higherBound, center + CHUNK_HALF_SIDE);
+  // Pending requests are all inside the ring, left ones were cancelled
+  bitset<RING_TILES * RING_TILES * RING_TILES> queued;
+  for (auto& request : requests) {
+    queued.set(ringSlot(request.lowerBound));
+  }
+  glm::ivec3 tile;
+  for (tile.z = lBound.z; tile.z < hBound.z; tile.z += CHUNK_LOAD_DELTA) {
+    for (tile.y = lBound.y; tile.y < hBound.y; tile.y += CHUNK_LOAD_DELTA) {
+      for (tile.x = lBound.x; tile.x < hBound.x; tile.x += CHUNK_LOAD_DELTA) {
+        auto slot = ringSlot(tile);
+        if (!queued[slot]) {
+          queued.set(slot);
+          requests.push_back({tile, 0.f});
+        }
+      }
+    }
+  }
+}
+
+void
+LoaderComponent::mShiftRing(int axis, int delta)
+{
+  glm::ivec3 lBound = center - CHUNK_HALF_SIDE;
+  glm::ivec3 hBound = center + CHUNK_HALF_SIDE;
+  if (delta < -(CHUNK_HALF_SIDE - CHUNK_LOAD_DELTA)) {
+    int areaToReload = getAreaToReload(delta);
+    center[axis] -= areaToReload;
+    lBound[axis] = center[axis] - CHUNK_HALF_SIDE;
+    hBound[axis] = lBound[axis] + areaToReload;
+  } else if (delta >= (CHUNK_HALF_SIDE - CHUNK_LOAD_DELTA)) {
+    int areaToReload = getAreaToReload(delta);
+    center[axis] += areaToReload;
+    hBound[axis] = center[axis] + CHUNK_HALF_SIDE;
+    lBound[axis] = hBound[axis] - areaToReload;
+  } else {
+    return;
+  }
+  // Whatever left the ring is going to be overwritten anyway
+  auto it = remove_if(requests.begin(), requests.end(), [&](auto& request) {
+    return !isInsideRing(request.lowerBound, center);
+  });
+  cancelledRequests += requests.end() - it;
+  requests.erase(it, requests.end());
+  mEnqueue(lBound, hBound);
+}
+
+void
+LoaderComponent::mPrioritize()
+{
+  auto  cameraPos = mCameraCell();
+  auto& cameraDir = scene()->camera->front();
+  for (auto& request : requests) {
+    glm::vec3 localPos =
+      glm::vec3(request.lowerBound) + CHUNK_LOAD_DELTA / 2.f - cameraPos;
+    float dist = glm::length(localPos);
+    float cosPos =
+      dist > CHUNK_LOAD_DELTA ? glm::dot(cameraDir, localPos / dist) : 1.f;
+    // Ahead counts 1x its distance, behind 3x
+    request.priority = dist * (2.f - cosPos);
+  }
+  auto count = min<size_t>(tilesPerFrame, requests.size());
+  partial_sort(requests.begin(),
+               requests.begin() + count,
+               requests.end(),
+               [](auto& lhs, auto& rhs) { return lhs.priority < rhs.priority; });
+}
+
+void
+LoaderComponent::mGenerate(const glm::ivec3& tile)
+{
+  glm::ivec3 lBound(tile.x & (CHUNK_SIDE - 1),
+                    tile.y & (CHUNK_SIDE - 1),
+                    tile.z & (CHUNK_SIDE - 1));
+  glm::ivec3 hBound = lBound + CHUNK_LOAD_DELTA;
+  glm::ivec3 offset = tile - lBound;
+  generator(lBound, hBound, offset, 1 << level, &scene()->clipmap(level));
+  scene()->markClipmapDirty(level, tile, tile + CHUNK_LOAD_DELTA);
 }
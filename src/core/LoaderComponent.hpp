@@ -1,5 +1,6 @@
 #pragma once
 #include <functional>
+#include <vector>
 #include <glm/glm.hpp>
 #include "SceneComponent.hpp"
 
@@ -14,23 +15,67 @@ class Chunk;
  *
  * the range is [lowerBound, higherBound, CHUNK_SIDE)),
  * inclusive, exclusive
+ *
+ * For clipmap levels each chunk cell stands for cellSide voxels of side, the
+ * cell at pos covering the world voxels from (pos + offset) * cellSide.
  */
 using SceneLoader = std::function<void(const glm::ivec3& lowerBound,
                                        const glm::ivec3& higherBound,
                                        const glm::ivec3& offset,
+                                       int               cellSide,
                                        Chunk*            chunk)>;
 
+/**
+ * @brief A pending tile to be generated
+ *
+ * Tiles are cubes of CHUNK_LOAD_DELTA side, aligned to it in world
+ * coordinates.
+ */
+struct LoadRequest
+{
+  glm::ivec3 lowerBound;
+  float      priority;
+};
+
+/**
+ * @brief Keeps the ring of a chunk generated around the camera
+ *
+ * The ring scrolls by tiles as the camera moves. With a level above 0 it
+ * fills that clipmap instead, center and tiles are then in its cells.
+ */
 struct LoaderComponent : public SceneComponent
 {
-  SceneLoader generator;
-  glm::ivec3  center{0};
+  SceneLoader              generator;
+  unsigned                 level = 0;
+  glm::ivec3               center{0};
+  unsigned                 tilesPerFrame     = 8;
+  unsigned                 cancelledRequests = 0;
+  std::vector<LoadRequest> requests;
 
   virtual void onUpdate(float delta) final;
 
+  /**
+   * @brief Discard everything and queue the whole ring around the camera
+   *
+   */
   void reset();
 
+  /**
+   * @brief Generate all pending requests right away
+   *
+   */
+  void flush();
+
   void sceneGenerator(SceneLoader sceneGenerator)
   {
     generator = sceneGenerator;
   }
-};
\ No newline at end of file
+
+private:
+  glm::vec3 mCameraCell() const;
+  void      mEnqueue(const glm::ivec3& lowerBound,
+                     const glm::ivec3& higherBound);
+  void      mShiftRing(int axis, int delta);
+  void      mPrioritize();
+  void      mGenerate(const glm::ivec3& tile);
+};
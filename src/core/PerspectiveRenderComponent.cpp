@@ -1,25 +1,29 @@
 #include "PerspectiveRenderComponent.hpp"
+#include <chrono>
+#include <GL/glew.h>
+#include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform.hpp>
 #include "Camera.hpp"
 #include "RenderInfo.hpp"
 #include "ResourcePool.hpp"
 #include "SceneDetail.hpp"
+#include "SectionMeshComponent.hpp"
+#include "Shader.hpp"
 #include "VoxelModel.hpp"
 #include "VoxelType.hpp"
 #include "util/fastMath.hpp"
 
 using namespace std;
 
-struct VoxelTypeImpl
+static const VoxelModel&
+voxelModel()
 {
-  shared_ptr<Texture> surfaceTexture;
-  shared_ptr<Texture> reliefTexture;
-  VoxelTypeImpl(shared_ptr<Texture> surfaceTexture,
-                shared_ptr<Texture> reliefTexture)
-    : surfaceTexture(move(surfaceTexture))
-    , reliefTexture(move(reliefTexture))
-  {}
-};
+  static VoxelModel model;
+  return model;
+}
+
+/// Seconds a relief map stays referenced after its last near or middle draw
+constexpr float RELIEF_RESIDENCY_TIME = 5.f;
 
 PerspectiveRenderComponent::PerspectiveRenderComponent(ResourcePool* pool,
                                                        float screenWidth,
@@ -28,21 +32,173 @@ PerspectiveRenderComponent::PerspectiveRenderComponent(ResourcePool* pool,
   , screenWidth(screenWidth)
   , screenHeight(screenHeight)
 {
-  nearShader   = pool->getShaderProgram("relief");
-  middleShader = pool->getShaderProgram("bump");
-  farShader    = pool->getShaderProgram("simple");
+  depthShader  = pool->getShaderProgram("depth");
+  shadowShader = pool->getShaderProgram("shadow");
+  // Albedo and normal, the latter in world space as normalMatrix is identity
+  impostorCaptureShader =
+    pool->getShaderProgram("simple", {{"DEFERRED", 1}, {"OCCLUSION", 1}});
+  upscaleShader = pool->getShaderProgram("upscale");
+  glGenQueries(FRAME_TIMERS, frameTimers);
+  loadShaders();
+}
+
+PerspectiveRenderComponent::~PerspectiveRenderComponent()
+{
+  pool->release(nearShader);
+  pool->release(middleShader);
+  pool->release(farShader);
+  pool->release(farMeshShader);
+  pool->release(clipmapShader);
+  pool->release(impostorShader);
+  pool->release(impostorCaptureShader);
+  pool->release(upscaleShader);
+  pool->release(depthShader);
+  pool->release(lightingShader);
+  pool->release(shadowShader);
+  glDeleteQueries(FRAME_TIMERS, frameTimers);
+  useSectionMeshes(nullptr);
+  for (auto& type : voxelTypes) {
+    pool->release(type.surfaceTexture);
+    pool->release(type.reliefTexture);
+  }
+}
+
+void
+PerspectiveRenderComponent::loadShaders()
+{
+  // Released after getting the new ones, so shared programs are not reloaded
+  ShaderHandle oldShaders[] = {nearShader,
+                               middleShader,
+                               farShader,
+                               farMeshShader,
+                               clipmapShader,
+                               impostorShader,
+                               lightingShader};
+  ShaderDefines nearDefines;
+  switch (reliefQuality) {
+    case ReliefQuality::LOW:
+      nearDefines = {{"LINEAR_SEARCH_STEPS", 8},
+                     {"BINARY_SEARCH_STEPS", 3},
+                     {"SELF_SHADOW", 0}};
+      break;
+    case ReliefQuality::MEDIUM:
+      nearDefines = {{"LINEAR_SEARCH_STEPS", 10}, {"BINARY_SEARCH_STEPS", 4}};
+      break;
+    case ReliefQuality::HIGH:
+      break;
+  }
+  if (depthPrePass) {
+    nearDefines.emplace_back("DEPTH_PRE_PASS", 1);
+  }
+  // Normal mapping only
+  ShaderDefines middleDefines = {{"PARALLAX", 0}, {"SELF_SHADOW", 0}};
+  ShaderDefines farDefines;
+  ShaderDefines impostorDefines;
+  ShaderDefines lightingDefines;
+  if (deferredShading) {
+    for (auto defines :
+         {&nearDefines, &middleDefines, &farDefines, &impostorDefines}) {
+      defines->emplace_back("DEFERRED", 1);
+    }
+  }
+  // Only one of the forward or the lighting pass applies them
+  bool castShadows = shadows && sectionMeshes;
+  if (castShadows) {
+    for (auto defines :
+         {&nearDefines, &middleDefines, &farDefines, &lightingDefines}) {
+      defines->emplace_back("SHADOWS", SHADOW_CASCADES);
+    }
+  }
+  bool useVoxelLight = voxelLight && lightVolume;
+  if (useVoxelLight) {
+    for (auto defines :
+         {&nearDefines, &middleDefines, &farDefines, &lightingDefines}) {
+      defines->emplace_back("LIGHT_VOLUME", 1);
+    }
+  }
+  nearShader            = pool->getShaderProgram("relief", nearDefines);
+  middleShader          = pool->getShaderProgram("relief", middleDefines);
+  farShader             = pool->getShaderProgram("simple", farDefines);
+  farDefines.emplace_back("OCCLUSION", 1);
+  farMeshShader         = pool->getShaderProgram("simple", farDefines);
+  farDefines.emplace_back("CLIPMAP_HOLE", 1);
+  clipmapShader         = pool->getShaderProgram("simple", farDefines);
+  impostorShader        = pool->getShaderProgram("impostor", impostorDefines);
+  lightingShader        = pool->getShaderProgram("deferred", lightingDefines);
+  loadedReliefQuality   = reliefQuality;
+  loadedDeferredShading = deferredShading;
+  loadedDepthPrePass    = depthPrePass;
+  loadedShadows         = castShadows;
+  loadedVoxelLight      = useVoxelLight;
+  for (auto shader : oldShaders) {
+    pool->release(shader);
+  }
 }
 
-PerspectiveRenderComponent::~PerspectiveRenderComponent() = default;
+void
+PerspectiveRenderComponent::useSectionMeshes(
+  shared_ptr<SectionMeshComponent> meshes)
+{
+  if (sectionMeshes) {
+    sectionMeshes->meshed.unsubscribe(meshedSubscription);
+  }
+  sectionMeshes = move(meshes);
+  if (sectionMeshes) {
+    // Rebuilt casters change the cascades around them
+    meshedSubscription =
+      sectionMeshes->meshed.subscribe([this](const DirtyRegion& region) {
+        if (shadowCascades) {
+          shadowCascades->invalidate(region);
+        }
+        if (impostorAtlas) {
+          impostorAtlas->invalidate(region);
+        }
+      });
+  }
+}
 
 void
 PerspectiveRenderComponent::onUpdate(float delta)
 {
+  if (reliefQuality != loadedReliefQuality ||
+      deferredShading != loadedDeferredShading ||
+      depthPrePass != loadedDepthPrePass ||
+      (shadows && sectionMeshes) != loadedShadows ||
+      (voxelLight && lightVolume) != loadedVoxelLight) {
+    loadShaders();
+  }
+  // Residency follows what the last frame drew, render() only reads it.
+  // Unreferenced relief maps stay cached until the pool needs the memory
+  clock += delta;
+  residentReliefTextures = 0;
+  for (size_t i = 0; i < voxelTypes.size(); ++i) {
+    auto& type = voxelTypes[i];
+    if (reliefDemand[i]) {
+      // It shows the flat placeholder until it is uploaded
+      if (!type.reliefTexture) {
+        type.reliefTexture = pool->getTexture(type.reliefPath);
+      }
+      type.reliefLastUse = clock;
+      reliefDemand[i]    = false;
+    } else if (type.reliefTexture &&
+               clock - type.reliefLastUse > RELIEF_RESIDENCY_TIME) {
+      pool->release(type.reliefTexture);
+      type.reliefTexture = {};
+    }
+    residentReliefTextures += bool(type.reliefTexture);
+  }
+  if (scaleResolution) {
+    scaleToFrameTime(delta);
+  }
   float radFov     = glm::radians(fov);
   float ratio      = screenWidth / screenHeight;
   cosFov           = cos(radFov / 2 * ratio + 0.375f);
   projection       = glm::perspective(radFov, ratio, near, far);
   view             = scene()->camera->makeView();
+  if (deferredShading) {
+    lightClusters.update(pointLights, view, radFov, ratio, near, far);
+    lightClusters.upload();
+  }
   auto& cameraDir  = scene()->camera->front();
   float cameraMagX = abs(cameraDir.x);
   float cameraMagY = abs(cameraDir.y);
@@ -63,18 +219,88 @@ PerspectiveRenderComponent::onUpdate(float delta)
 void
 PerspectiveRenderComponent::render() const
 {
+  auto cpuStart = chrono::steady_clock::now();
+  auto timer    = frameTimers[framesTimed % FRAME_TIMERS];
+  if (framesTimed >= FRAME_TIMERS) {
+    int available = 0;
+    glGetQueryObjectiv(timer, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available) {
+      GLuint64 elapsed = 0;
+      glGetQueryObjectui64v(timer, GL_QUERY_RESULT, &elapsed);
+      gpuFrameTime = elapsed / 1e6f;
+    }
+  }
+  glBeginQuery(GL_TIME_ELAPSED, timer);
+
   auto& cameraDir = scene()->camera->front();
   auto& cameraPos = scene()->camera->position();
   voxelsRendered  = 0;
+  voxelsVisited   = 0;
   RenderInfo renderInfo;
-  renderInfo.projection = projection;
-  renderInfo.view       = view;
-  int axisJ             = (axisI + 1) % 3;
-  int axisK             = (axisI + 2) % 3;
-  int begI              = int(cameraPos[axisI]);
-  int baseJ             = int(cameraPos[axisJ]);
-  int baseK             = int(cameraPos[axisK]);
-  int begBiasJ, endBiasJ;
+  renderInfo.projection     = projection;
+  renderInfo.view           = view;
+  renderInfo.reliefProperty = reliefProperty;
+
+  // Voxel models only translate, so it is the same for all of them
+  renderInfo.normalMatrix = glm::transpose(glm::inverse(glm::mat3(view)));
+
+  if (loadedShadows) {
+    renderShadows(renderInfo);
+  }
+  if (loadedVoxelLight) {
+    bindLightVolume(renderInfo);
+  }
+  if (impostors && meshFarBand && sectionMeshes) {
+    captureImpostors(renderInfo);
+  }
+
+  // After the shadows and snapshots, they leave the window framebuffer bound
+  int  renderWidth  = max(1, int(screenWidth * resolutionScale));
+  int  renderHeight = max(1, int(screenHeight * resolutionScale));
+  bool upscale      = resolutionScale < 1.f;
+  if (upscale) {
+    if (!sceneBuffer) {
+      sceneBuffer = make_unique<FrameBuffer>(
+        renderWidth, renderHeight, vector<unsigned>{GL_RGBA8});
+    }
+    sceneBuffer->resize(renderWidth, renderHeight);
+    sceneBuffer->bind();
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  }
+
+  bool blending = glIsEnabled(GL_BLEND);
+  if (deferredShading) {
+    if (!gBuffer) {
+      gBuffer = make_unique<FrameBuffer>(
+        renderWidth, renderHeight, vector<unsigned>{GL_RGBA8, GL_RGBA16F});
+    }
+    gBuffer->resize(renderWidth, renderHeight);
+    gBuffer->bind();
+    // Zero alpha marks pixels without geometry, lighting leaves them alone
+    float clearColor[4] = {0, 0, 0, 0};
+    float clearDepth    = 1;
+    glClearBufferfv(GL_COLOR, 0, clearColor);
+    glClearBufferfv(GL_COLOR, 1, clearColor);
+    glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+    // Blending would mix normals
+    glDisable(GL_BLEND);
+  }
+
+  meshedSections.clear();
+  sectionsRendered  = 0;
+  sectionTriangles  = 0;
+  impostorsRendered = 0;
+  if (meshFarBand && sectionMeshes) {
+    renderFarSections(renderInfo, cameraPos, cameraDir);
+  }
+
+  float reach = traversalReach();
+  int   axisJ = (axisI + 1) % 3;
+  int   axisK = (axisI + 2) % 3;
+  int   begI  = int(cameraPos[axisI]);
+  int   baseJ = int(cameraPos[axisJ]);
+  int   baseK = int(cameraPos[axisK]);
+  int   begBiasJ, endBiasJ;
   if (cameraDir[axisJ] > .25) {
     begBiasJ = 1;
     endBiasJ = 3;
@@ -99,7 +325,7 @@ PerspectiveRenderComponent::render() const
   }
 
   if (signbit(cameraDir[axisI])) {
-    int        endI = int(cameraPos[axisI] - far);
+    int        endI = int(cameraPos[axisI] - reach);
     glm::ivec3 pos;
     auto       faceBitSet = ~(0x1 << (axisI * 2)) & 0x3f;
     int        baseI      = int(cameraPos[axisI]) + 1;
@@ -154,7 +380,7 @@ PerspectiveRenderComponent::render() const
         break;
     }
   } else {
-    int        endI = int(cameraPos[axisI] + far);
+    int        endI = int(cameraPos[axisI] + reach);
     glm::ivec3 pos;
     auto       faceBitSet = ~(0x2 << (axisI * 2)) & 0x3f;
     int        baseI      = int(cameraPos[axisI]) - 1;
@@ -208,6 +434,28 @@ PerspectiveRenderComponent::render() const
         break;
     }
   }
+  renderNearBand();
+  if (deferredShading) {
+    if (blending) {
+      glEnable(GL_BLEND);
+    }
+    if (upscale) {
+      sceneBuffer->bind();
+    } else {
+      FrameBuffer::unbind();
+      glViewport(0, 0, screenWidth, screenHeight);
+    }
+    renderLighting(renderInfo);
+  }
+  if (upscale) {
+    renderUpscale();
+  }
+
+  glEndQuery(GL_TIME_ELAPSED);
+  ++framesTimed;
+  chrono::duration<float, milli> cpuTime =
+    chrono::steady_clock::now() - cpuStart;
+  cpuFrameTime = cpuTime.count();
 }
 
 inline bool
@@ -216,6 +464,7 @@ PerspectiveRenderComponent::renderVoxel(RenderInfo&       renderInfo,
                                         const glm::vec3&  cameraDir,
                                         const glm::ivec3& iPos) const
 {
+  ++voxelsVisited;
   Chunk& chunk    = scene()->chunk;
   auto&  nodeData = chunk.at(iPos);
   if (nodeData.blockType == NO_BLOCK) {
@@ -228,6 +477,10 @@ PerspectiveRenderComponent::renderVoxel(RenderInfo&       renderInfo,
   if (dist < 1) {
     return false;
   }
+  // Drawn with its section mesh
+  if (dist * meshBandStart() < far && meshedSections.count(sectionKey(iPos))) {
+    return false;
+  }
   glm::vec3 nPos   = glm::normalize(localPos);
   float     cosPos = glm::dot(cameraDir, nPos);
   if (abs(cosPos) < cosFov) {
@@ -252,28 +505,345 @@ PerspectiveRenderComponent::renderVoxel(RenderInfo&       renderInfo,
     renderInfo.faceBitSet &= ~BOTTOM;
   }
 
-  if (dist * farLod < 1) {
+  auto& type                = voxelTypes[nodeData.blockType - 1];
+  renderInfo.model          = glm::translate(pos);
+  renderInfo.surfaceTexture = type.surfaceTexture;
+  bool relief               = dist * farLod >= 1;
+  if (relief) {
+    reliefDemand[nodeData.blockType - 1] = true;
+    relief                               = bool(type.reliefTexture);
+  }
+  if (!relief) {
     renderInfo.shaderProgram = farShader;
-  } else if (dist * middleLod < 1) {
-    renderInfo.shaderProgram = middleShader;
+    renderInfo.reliefTexture = {};
   } else {
-    renderInfo.shaderProgram = nearShader;
+    if (dist * middleLod < 1) {
+      renderInfo.shaderProgram = middleShader;
+    } else {
+      renderInfo.shaderProgram = nearShader;
+    }
+    renderInfo.reliefTexture = type.reliefTexture;
   }
-
-  renderInfo.model          = glm::translate(pos);
-  auto blockIndex           = nodeData.blockType - 1;
-  renderInfo.surfaceTexture = voxelTypes[blockIndex].surfaceTexture;
-  renderInfo.reliefTexture  = voxelTypes[blockIndex].reliefTexture;
-  static VoxelModel voxelModel;
-  voxelModel.render(renderInfo);
   ++voxelsRendered;
+  if (depthPrePass && renderInfo.shaderProgram == nearShader) {
+    nearDraws.push_back(renderInfo);
+  } else {
+    voxelModel().render(renderInfo, *pool);
+  }
   return true;
 }
 
+void
+PerspectiveRenderComponent::renderNearBand() const
+{
+  if (nearDraws.empty()) {
+    return;
+  }
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  for (auto renderInfo : nearDraws) {
+    renderInfo.shaderProgram = depthShader;
+    voxelModel().render(renderInfo, *pool);
+  }
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+  glDepthFunc(GL_EQUAL);
+  glDepthMask(GL_FALSE);
+  for (auto& renderInfo : nearDraws) {
+    voxelModel().render(renderInfo, *pool);
+  }
+  glDepthMask(GL_TRUE);
+  glDepthFunc(GL_LESS);
+  nearDraws.clear();
+}
+
+float
+PerspectiveRenderComponent::meshBandStart() const
+{
+  return min(far * farLod, CHUNK_HALF_SIDE - SECTION_DIAGONAL);
+}
+
+float
+PerspectiveRenderComponent::traversalReach() const
+{
+  if (meshFarBand && sectionMeshes) {
+    return min(far, meshBandStart() + SECTION_DIAGONAL);
+  }
+  return min(far, float(CHUNK_HALF_SIDE));
+}
+
+void
+PerspectiveRenderComponent::renderFarSections(RenderInfo       renderInfo,
+                                              const glm::vec3& cameraPos,
+                                              const glm::vec3& cameraDir) const
+{
+  float farStart           = meshBandStart();
+  float reach              = traversalReach();
+  float halfFov            = acos(cosFov);
+  renderInfo.model         = glm::mat4(1.f);
+  renderInfo.reliefTexture = {};
+  // Each clipmap level is cut where the one below it has sections
+  DirtyRegion holes[CLIPMAP_LEVELS + 1];
+  for (unsigned level = 1; level <= CLIPMAP_LEVELS; ++level) {
+    holes[level] = sectionRing(level - 1, cameraPos);
+  }
+  for (auto& [key, mesh] : sectionMeshes->sections) {
+    float     side = SECTION_SIDE << mesh.clipmapLevel;
+    glm::vec3 lowerBound(mesh.lowerBound);
+    auto      nearest =
+      glm::clamp(cameraPos, lowerBound, lowerBound + side);
+    float nearestDist = glm::length(nearest - cameraPos);
+    if (nearestDist >= far) {
+      continue;
+    }
+    auto& hole = holes[mesh.clipmapLevel];
+    if (mesh.clipmapLevel == 0) {
+      if (nearestDist < farStart) {
+        continue;
+      }
+      // Until rebuilt its voxels are drawn one by one
+      if (mesh.dirty && nearestDist < reach) {
+        continue;
+      }
+      meshedSections.insert(key);
+    } else if (hole.contains(mesh.lowerBound) &&
+               hole.contains(mesh.lowerBound + int(side) - 1)) {
+      continue;
+    }
+    if (!mesh.indexCount) {
+      continue;
+    }
+    auto  localPos = lowerBound + side / 2 - cameraPos;
+    float dist     = glm::length(localPos);
+    float angle =
+      acos(glm::clamp(glm::dot(cameraDir, localPos / dist), -1.f, 1.f));
+    float radius = side * SECTION_DIAGONAL / SECTION_SIDE / 2;
+    if (angle > halfFov + asin(min(radius / dist, 1.f))) {
+      continue;
+    }
+    // Clear of the finer levels, as the quad is not cut
+    DirtyRegion bounds{mesh.lowerBound, mesh.lowerBound + int(side)};
+    bool        clear = mesh.clipmapLevel == 0 || !hole.intersects(bounds);
+    if (impostors && impostorAtlas && nearestDist >= impostorStart && clear &&
+        impostorAtlas->add(key, mesh, cameraPos)) {
+      ++impostorsRendered;
+      continue;
+    }
+    ++sectionsRendered;
+    renderInfo.shaderProgram =
+      mesh.clipmapLevel ? clipmapShader : farMeshShader;
+    for (auto& range : mesh.ranges) {
+      renderInfo.surfaceTexture =
+        voxelTypes[range.blockType - 1].surfaceTexture;
+      if (!useRenderInfo(renderInfo, *pool)) {
+        continue;
+      }
+      if (mesh.clipmapLevel) {
+        auto shaderProgram = pool->shaderProgram(clipmapShader);
+        glUniform3fv(shaderProgram->getUniformLocation("holeLowerBound"),
+                     1,
+                     glm::value_ptr(glm::vec3(hole.lowerBound)));
+        glUniform3fv(shaderProgram->getUniformLocation("holeHigherBound"),
+                     1,
+                     glm::value_ptr(glm::vec3(hole.higherBound)));
+      }
+      sectionMeshes->draw(mesh, range);
+      sectionTriangles += range.count / 3;
+    }
+  }
+  if (impostorsRendered) {
+    renderInfo.shaderProgram = impostorShader;
+    if (auto shaderProgram = useRenderInfo(renderInfo, *pool)) {
+      glUniform1i(shaderProgram->getUniformLocation("normalTex"), 1);
+      impostorAtlas->draw();
+    }
+  }
+}
+
+void
+PerspectiveRenderComponent::captureImpostors(RenderInfo renderInfo) const
+{
+  if (!impostorAtlas) {
+    impostorAtlas = make_unique<SectionImpostors>();
+  }
+  renderInfo.shaderProgram = impostorCaptureShader;
+  renderInfo.model         = glm::mat4(1.f);
+  renderInfo.normalMatrix  = glm::mat3(1.f);
+  renderInfo.reliefTexture = {};
+  impostorAtlas->capture(
+    *sectionMeshes, [&](const SectionMesh& mesh, const ImpostorView& view) {
+      renderInfo.view       = view.view;
+      renderInfo.projection = view.projection;
+      for (auto& range : mesh.ranges) {
+        renderInfo.surfaceTexture =
+          voxelTypes[range.blockType - 1].surfaceTexture;
+        if (useRenderInfo(renderInfo, *pool)) {
+          sectionMeshes->draw(mesh, range);
+        }
+      }
+    });
+  glViewport(0, 0, screenWidth, screenHeight);
+}
+
+void
+PerspectiveRenderComponent::renderShadows(const RenderInfo& renderInfo) const
+{
+  if (!shadowCascades) {
+    shadowCascades = make_unique<ShadowCascades>();
+  }
+  if (auto shaderProgram = pool->shaderProgram(shadowShader)) {
+    shadowCascades->update(*sectionMeshes,
+                           scene()->camera->position(),
+                           glm::vec3(renderInfo.lightSource),
+                           *shaderProgram);
+    glViewport(0, 0, screenWidth, screenHeight);
+  }
+  for (auto shader : {nearShader,
+                      middleShader,
+                      farShader,
+                      farMeshShader,
+                      clipmapShader,
+                      lightingShader}) {
+    if (auto shaderProgram = pool->shaderProgram(shader)) {
+      shadowCascades->bind(*shaderProgram, renderInfo.view);
+    }
+  }
+}
+
+void
+PerspectiveRenderComponent::bindLightVolume(const RenderInfo& renderInfo) const
+{
+  lightVolume->bind(LIGHT_VOLUME_UNIT);
+  // Only the lighting pass needs it, the others have world positions
+  auto inverseView = glm::inverse(renderInfo.view);
+  for (auto shader : {nearShader,
+                      middleShader,
+                      farShader,
+                      farMeshShader,
+                      clipmapShader,
+                      lightingShader}) {
+    if (auto shaderProgram = pool->shaderProgram(shader)) {
+      glUseProgram(shaderProgram->shaderProgramId());
+      glUniform1i(shaderProgram->getUniformLocation("lightVolume"),
+                  LIGHT_VOLUME_UNIT);
+      glUniform3iv(shaderProgram->getUniformLocation("lightVolumeLowerBound"),
+                   1,
+                   glm::value_ptr(lightVolume->ringLowerBound()));
+      glUniformMatrix4fv(shaderProgram->getUniformLocation("inverseView"),
+                         1,
+                         GL_FALSE,
+                         glm::value_ptr(inverseView));
+    }
+  }
+}
+
+void
+PerspectiveRenderComponent::renderLighting(const RenderInfo& renderInfo) const
+{
+  auto shaderProgram = pool->shaderProgram(lightingShader);
+  if (!shaderProgram) {
+    return;
+  }
+  glUseProgram(shaderProgram->shaderProgramId());
+  glUniformMatrix4fv(shaderProgram->getUniformLocation("view"),
+                     1,
+                     GL_FALSE,
+                     glm::value_ptr(renderInfo.view));
+  glUniform1f(shaderProgram->getUniformLocation("ambient"),
+              renderInfo.lightProperty.ambient);
+  glUniform1f(shaderProgram->getUniformLocation("diffuse"),
+              renderInfo.lightProperty.diffuse);
+  glUniform4fv(shaderProgram->getUniformLocation("lightColor"),
+               1,
+               glm::value_ptr(renderInfo.lightColor));
+  glUniform4fv(shaderProgram->getUniformLocation("lightSource"),
+               1,
+               glm::value_ptr(glm::normalize(renderInfo.lightSource)));
+  glUniformMatrix4fv(shaderProgram->getUniformLocation("inverseProjection"),
+                     1,
+                     GL_FALSE,
+                     glm::value_ptr(glm::inverse(renderInfo.projection)));
+  glUniform3i(shaderProgram->getUniformLocation("clusterCount"),
+              CLUSTER_COLUMNS,
+              CLUSTER_ROWS,
+              CLUSTER_SLICES);
+  glUniform1f(shaderProgram->getUniformLocation("clusterNear"),
+              lightClusters.near());
+  glUniform1f(shaderProgram->getUniformLocation("clusterFar"),
+              lightClusters.far());
+  glUniform1i(shaderProgram->getUniformLocation("albedoTex"), 0);
+  glUniform1i(shaderProgram->getUniformLocation("normalTex"), 1);
+  glUniform1i(shaderProgram->getUniformLocation("depthTex"), 2);
+  glUniform1i(shaderProgram->getUniformLocation("lightData"), 3);
+  glUniform1i(shaderProgram->getUniformLocation("lightGrid"), 4);
+  glUniform1i(shaderProgram->getUniformLocation("lightIndices"), 5);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, gBuffer->colorTexture(0));
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, gBuffer->colorTexture(1));
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, gBuffer->depthTexture());
+  lightClusters.bind(3);
+  glActiveTexture(GL_TEXTURE0);
+
+  glDisable(GL_DEPTH_TEST);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glEnable(GL_DEPTH_TEST);
+}
+
+void
+PerspectiveRenderComponent::scaleToFrameTime(float delta)
+{
+  resolutionClock += delta;
+  float frameTime = max(gpuFrameTime, cpuFrameTime);
+  if (resolutionClock < RESOLUTION_SETTLE_TIME || frameTime <= 0) {
+    return;
+  }
+  float scale = resolutionScale;
+  float up    = min(scale + RESOLUTION_STEP, 1.f);
+  if (frameTime > targetFrameTime) {
+    scale = max(scale - RESOLUTION_STEP, MIN_RESOLUTION_SCALE);
+  } else if (frameTime * (up * up) / (scale * scale) < targetFrameTime) {
+    scale = up;
+  }
+  if (scale != resolutionScale) {
+    resolutionScale = scale;
+    resolutionClock = 0;
+  }
+}
+
+void
+PerspectiveRenderComponent::renderUpscale() const
+{
+  FrameBuffer::unbind();
+  glViewport(0, 0, screenWidth, screenHeight);
+  auto shaderProgram = pool->shaderProgram(upscaleShader);
+  if (!shaderProgram) {
+    return;
+  }
+  glUseProgram(shaderProgram->shaderProgramId());
+  glUniform1i(shaderProgram->getUniformLocation("sceneTex"), 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, sceneBuffer->colorTexture(0));
+  // The targets are made with nearest filtering, it would show the pixels
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+  // The scene was blended already, and has no depth to test against here
+  bool blending = glIsEnabled(GL_BLEND);
+  glDisable(GL_BLEND);
+  glDisable(GL_DEPTH_TEST);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+  glEnable(GL_DEPTH_TEST);
+  if (blending) {
+    glEnable(GL_BLEND);
+  }
+}
+
 unsigned
 PerspectiveRenderComponent::insertVoxelType(const VoxelType& type)
 {
-  voxelTypes.emplace_back(pool->getTexture(type.surfaceTexture),
-                          pool->getTexture(type.reliefTexture));
+  voxelTypes.push_back(
+    {pool->getTexture(type.surfaceTexture), type.reliefTexture});
+  reliefDemand.push_back(false);
   return voxelTypes.size();
 }
@@ -1,14 +1,57 @@
 #pragma once
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <unordered_set>
 #include <vector>
 #include <glm/glm.hpp>
+#include "FrameBuffer.hpp"
+#include "LightClusters.hpp"
+#include "LightVolumeComponent.hpp"
+#include "RenderInfo.hpp"
+#include "ResourceHandle.hpp"
 #include "SceneComponent.hpp"
+#include "SectionImpostors.hpp"
+#include "ShadowCascades.hpp"
 
-class RenderInfo;
 class ResourcePool;
-class ShaderProgram;
+struct SectionMeshComponent;
 class VoxelType;
-class VoxelTypeImpl;
+
+/**
+ * @brief Quality presets for the near band relief shader
+ *
+ */
+enum class ReliefQuality : int
+{
+  LOW,
+  MEDIUM,
+  HIGH,
+};
+
+/**
+ * @brief The textures of a voxel type, as the renderer keeps them
+ *
+ * Only the near and middle bands sample the relief map, so it is requested
+ * after the first frame one of them wants the type and released after a while
+ * without them. Until it is resident the type is drawn as in the far band.
+ */
+struct VoxelMaterial
+{
+  TextureHandle surfaceTexture;
+  std::string   reliefPath;
+  TextureHandle reliefTexture;
+  float         reliefLastUse = 0;
+};
+
+/// GPU timer queries in flight, frames are read back this many frames late
+constexpr unsigned FRAME_TIMERS = 3;
+/// Lowest resolutionScale scaleResolution goes down to
+constexpr float MIN_RESOLUTION_SCALE = .5f;
+/// Change of resolutionScale at a time, the targets are recreated on each one
+constexpr float RESOLUTION_STEP = 1.f / 16;
+/// Seconds between changes, so the frame time measures the last one
+constexpr float RESOLUTION_SETTLE_TIME = .25f;
 
 /**
  * @brief A component to render the scene in perspective
@@ -16,24 +59,83 @@ class VoxelTypeImpl;
  */
 struct PerspectiveRenderComponent : public SceneComponent
 {
-  ResourcePool* pool;
-  float         screenWidth;
-  float         screenHeight;
-  float         fov       = 30.f;
-  float         near      = 2.f;
-  float         far       = 50.f;
-  float         middleLod = .75f;
-  float         farLod    = .95f;
+  ResourcePool*  pool;
+  float          screenWidth;
+  float          screenHeight;
+  float          fov             = 30.f;
+  float          near            = 2.f;
+  float          far             = 50.f;
+  float          middleLod       = .75f;
+  float          farLod          = .95f;
+  float          impostorStart   = 640.f;
+  ReliefQuality  reliefQuality   = ReliefQuality::HIGH;
+  ReliefProperty reliefProperty;
+  bool           depthPrePass    = true;
+  bool           deferredShading = false;
+  bool           shadows         = true;
+  bool           meshFarBand     = true;
+  bool           voxelLight      = true;
+  bool           impostors       = true;
+  bool           scaleResolution = true;
+  float          targetFrameTime = 16.6f;
+  float          resolutionScale = 1.f;
   // VoxelModel                voxelModel;
-  mutable unsigned               voxelsRendered = 0;
-  std::shared_ptr<ShaderProgram> nearShader;
-  std::shared_ptr<ShaderProgram> middleShader;
-  std::shared_ptr<ShaderProgram> farShader;
-  float                          cosFov;
-  int                            axisI;
-  std::vector<VoxelTypeImpl>     voxelTypes;
-  glm::mat4                      projection;
-  glm::mat4                      view;
+  mutable unsigned           voxelsRendered         = 0;
+  mutable unsigned           voxelsVisited          = 0;
+  mutable unsigned           sectionsRendered       = 0;
+  mutable unsigned           sectionTriangles       = 0;
+  mutable unsigned           impostorsRendered      = 0;
+  mutable float              gpuFrameTime           = 0;
+  mutable float              cpuFrameTime           = 0;
+  unsigned                   residentReliefTextures = 0;
+  ShaderHandle               nearShader;
+  ShaderHandle               middleShader;
+  ShaderHandle               farShader;
+  ShaderHandle               farMeshShader;
+  ShaderHandle               clipmapShader;
+  ShaderHandle               impostorShader;
+  ShaderHandle               impostorCaptureShader;
+  ShaderHandle               upscaleShader;
+  ShaderHandle               depthShader;
+  ShaderHandle               lightingShader;
+  ShaderHandle               shadowShader;
+  ReliefQuality              loadedReliefQuality;
+  bool                       loadedDeferredShading;
+  bool                       loadedDepthPrePass;
+  bool                       loadedShadows;
+  bool                       loadedVoxelLight;
+  float                      cosFov;
+  int                        axisI;
+  float                      clock = 0;
+  std::vector<VoxelMaterial> voxelTypes;
+  /// Types a relief band wanted this frame, onUpdate() makes their maps
+  /// resident
+  mutable std::vector<bool> reliefDemand;
+  /// Only lit by deferredShading
+  std::vector<PointLight> pointLights;
+  LightClusters           lightClusters;
+  /// Near band draws, deferred to render them after the depth pre-pass
+  mutable std::vector<RenderInfo> nearDraws;
+  /// Albedo, then normal and relief shadow, for deferredShading
+  mutable std::unique_ptr<FrameBuffer> gBuffer;
+  /// The shadow casters, shadows need them
+  std::shared_ptr<SectionMeshComponent>   sectionMeshes;
+  unsigned                                meshedSubscription = 0;
+  mutable std::unique_ptr<ShadowCascades> shadowCascades;
+  /// Sections drawn from their mesh this frame, their voxels are skipped
+  mutable std::unordered_set<uint64_t> meshedSections;
+  /// Snapshots of the sections past impostorDistance, for impostors
+  mutable std::unique_ptr<SectionImpostors> impostorAtlas;
+  /// The scene below the window size, upscaled to it at the end of render()
+  mutable std::unique_ptr<FrameBuffer> sceneBuffer;
+  /// Frames in flight, the oldest one is read back when starting a frame
+  unsigned         frameTimers[FRAME_TIMERS];
+  mutable unsigned framesTimed     = 0;
+  float            resolutionClock = 0;
+  /// Sky and block light, voxelLight needs it
+  std::shared_ptr<LightVolumeComponent> lightVolume;
+  glm::mat4                  projection;
+  glm::mat4                  view;
 
   PerspectiveRenderComponent(ResourcePool* pool,
                              float         screenWidth,
@@ -42,8 +144,102 @@ struct PerspectiveRenderComponent : public SceneComponent
 
   virtual void onUpdate(float delta) final;
 
+  /**
+   * @brief (Re)load the shader permutations for the current settings
+   *
+   */
+  void loadShaders();
+
+  /**
+   * @brief Cast shadows from these meshes, replacing the previous ones
+   *
+   */
+  void useSectionMeshes(std::shared_ptr<SectionMeshComponent> meshes);
+
   void render() const;
 
+  /**
+   * @brief Fill the depth buffer with the near band, then shade it with an
+   * EQUAL depth test, so relief runs at most once per pixel
+   *
+   */
+  void renderNearBand() const;
+
+  /**
+   * @brief Where meshFarBand starts drawing sections from their meshes
+   *
+   * The far band start, unless it leaves no room for a section before the end
+   * of the chunk ring.
+   */
+  float meshBandStart() const;
+
+  /**
+   * @brief How far the voxel traversal goes
+   *
+   * With meshFarBand, past the mesh band start and a section diagonal every
+   * section is drawn from its mesh, so it stops there. It never goes past the
+   * chunk ring, the chunk holds other voxels there.
+   */
+  float traversalReach() const;
+
+  /**
+   * @brief Draw the sections entirely in the mesh band from their meshes
+   *
+   * Dirty sections in reach of the traversal are left to it, the ones beyond
+   * keep their last mesh until rebuilt. Clipmap sections follow up to far,
+   * skipping the ones under the next finer level and cutting the others where
+   * it draws, see sectionRing(). Past impostorStart, the sections clear of
+   * finer levels are drawn as impostors once they have a snapshot.
+   */
+  void renderFarSections(RenderInfo       renderInfo,
+                         const glm::vec3& cameraPos,
+                         const glm::vec3& cameraDir) const;
+
+  /**
+   * @brief Take the impostor snapshots queued on the last frames
+   *
+   * @param renderInfo where the light is taken from
+   */
+  void captureImpostors(RenderInfo renderInfo) const;
+
+  /**
+   * @brief Bring the shadow cascades up to date and give them to the shaders
+   *
+   * @param renderInfo where the light is taken from
+   */
+  void renderShadows(const RenderInfo& renderInfo) const;
+
+  /**
+   * @brief Give the light volume to the shaders using LIGHT_VOLUME
+   *
+   * @param renderInfo where the view is taken from
+   */
+  void bindLightVolume(const RenderInfo& renderInfo) const;
+
+  /**
+   * @brief Light the gBuffer into the current framebuffer
+   *
+   * The directional light covers every pixel, point lights only their
+   * clusters.
+   * @param renderInfo where the light is taken from
+   */
+  void renderLighting(const RenderInfo& renderInfo) const;
+
+  /**
+   * @brief Move resolutionScale toward targetFrameTime
+   *
+   * The frame time is the largest of the GPU and the CPU time of render().
+   * Pixels cost about the square of the scale: it steps down past the target,
+   * and up only when the time predicted for the next step stays below it.
+   */
+  void scaleToFrameTime(float delta);
+
+  /**
+   * @brief Stretch sceneBuffer over the window framebuffer, filtered
+   *
+   */
+  void renderUpscale() const;
+
   inline bool renderVoxel(RenderInfo&       renderInfo,
                           const glm::vec3&  cameraPos,
                           const glm::vec3&  cameraDir,
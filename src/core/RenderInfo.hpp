@@ -1,6 +1,6 @@
 #pragma once
-#include <memory>
 #include <glm/glm.hpp>
+#include "ResourceHandle.hpp"
 
 enum VoxelFace
 {
@@ -19,21 +19,32 @@ struct LightProperty
   float specular{0.f};
 };
 
-// Forward decl
-class ShaderProgram;
-class Texture;
+/**
+ * @brief Adaptive step counts of the relief search
+ *
+ * The shader permutation sets the maximum, see ReliefQuality.
+ */
+struct ReliefProperty
+{
+  float stepsPerPixel{.5f};
+  int   minSteps{4};
+};
 
 struct RenderInfo
 {
-  glm::mat4                      model{1.f};
-  glm::mat4                      view{1.f};
-  glm::mat4                      projection{1.f};
-  glm::vec4                      tintColor{1.f};
-  std::shared_ptr<ShaderProgram> shaderProgram;
-  std::shared_ptr<Texture>       surfaceTexture;
-  std::shared_ptr<Texture>       reliefTexture;
-  unsigned                       faceBitSet{0xff};
-  LightProperty                  lightProperty;
-  glm::vec4                      lightColor{.8f};
-  glm::vec4                      lightSource{1.f, 1.f, -1.f, 0.f};
+  glm::mat4      model{1.f};
+  glm::mat4      view{1.f};
+  glm::mat4      projection{1.f};
+  /// Inverse transpose of view * model, without the translation
+  glm::mat3      normalMatrix{1.f};
+  glm::vec4      tintColor{1.f};
+  ShaderHandle   shaderProgram;
+  TextureHandle  surfaceTexture;
+  TextureHandle  reliefTexture;
+  unsigned       faceBitSet{0xff};
+  LightProperty  lightProperty;
+  ReliefProperty reliefProperty;
+  glm::vec4      lightColor{.8f};
+  /// Direction the light travels in world space, for shading and shadows
+  glm::vec4      lightSource{1.f, 1.f, -1.f, 0.f};
 };
@@ -0,0 +1,11 @@
+#pragma once
+#include "Handle.hpp"
+
+// Forward declaration
+class ShaderProgram;
+class Texture;
+struct Material;
+
+using ShaderHandle   = Handle<ShaderProgram>;
+using TextureHandle  = Handle<Texture>;
+using MaterialHandle = Handle<Material>;
@@ -1,91 +1,549 @@
 #include "ResourcePool.hpp"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
 #include <unordered_map>
+#include <vector>
+#include <GL/glew.h>
 #include "Shader.hpp"
 #include "Texture.hpp"
+#include "TextureLoader.hpp"
+#include "util/FileWatcher.hpp"
+#include "util/assetArchive.hpp"
+#include "util/fileReader.hpp"
+#include "util/hash.hpp"
 
 using namespace std;
 
+/// Bytes uploaded per update(), about a 1024x1024 RGBA texture
+constexpr size_t TEXTURE_UPLOAD_BUDGET = 4 * 1024 * 1024;
+
 /**
- * @brief A pool of currently used textures.
+ * @brief Loads textures for the ResourcePool
  *
- * This allow for easier sharing
+ * Textures are decoded asynchronously, showing a placeholder until they are
+ * uploaded.
  */
 class TexturePool
 {
 public:
-  std::shared_ptr<Texture> get(const std::string& fileName);
+  std::shared_ptr<Texture> load(const std::string& fileName);
+
+  TextureLoader& loader() { return mLoader; }
 
 private:
-  std::unordered_map<std::string, std::shared_ptr<Texture>> mTexturePool;
+  TextureLoader mLoader;
 };
 
+constexpr char SHADER_CACHE_DIR[] = "cache/shaders/";
+
 /**
- * @brief Allow simplified Shader sharing
+ * @brief Loads shader programs for the ResourcePool
  *
+ * Linked programs are kept in SHADER_CACHE_DIR, keyed by their sources and the
+ * driver, so next runs can skip compilation.
  */
 class ShaderPool
 {
 public:
-  std::shared_ptr<ShaderProgram> get(const std::string& name);
+  ShaderPool();
+
+  std::shared_ptr<ShaderProgram> load(const std::string& name,
+                                      const std::string& preamble);
 
 private:
-  std::unordered_map<std::string, std::shared_ptr<ShaderProgram>> mProgramPool;
-  std::unordered_map<std::string, std::shared_ptr<Shader>>        mShaderPool;
+  std::string mBinaryPath(const std::string& name,
+                          std::string_view   preamble,
+                          std::string_view   vertexSource,
+                          std::string_view   fragmentSource) const;
+  std::shared_ptr<ShaderProgram> mLoadBinary(const std::string& path) const;
+  void mSaveBinary(const std::string&   path,
+                   const ShaderProgram& program) const;
+
+private:
+  uint64_t mDriverHash;
 };
 
+/**
+ * @brief Visit the pieces of a shader program name without building it
+ *
+ * The name is the shader name, a line break and the preamble, with a #define
+ * line per define. Hashing, comparing and building it all go through here, so
+ * they can not disagree.
+ */
+template<class CALLBACK>
+static void
+forEachShaderNamePiece(string_view          name,
+                       const ShaderDefines& defines,
+                       CALLBACK             callback)
+{
+  callback(name);
+  callback("\n");
+  for (auto& define : defines) {
+    char value[16];
+    auto result = to_chars(begin(value), end(value), define.second);
+    callback("#define ");
+    callback(define.first);
+    callback(" ");
+    callback(string_view(value, result.ptr - value));
+    callback("\n");
+  }
+}
+
+static bool
+matchesShaderName(string_view          fullName,
+                  string_view          name,
+                  const ShaderDefines& defines)
+{
+  bool matches = true;
+  forEachShaderNamePiece(name, defines, [&](string_view piece) {
+    matches  = matches && fullName.substr(0, piece.size()) == piece;
+    fullName = fullName.substr(min(piece.size(), fullName.size()));
+  });
+  return matches && fullName.empty();
+}
+
+/// Material names are both texture paths separated by a line break
+static bool
+matchesMaterialName(string_view fullName,
+                    string_view surfaceTexture,
+                    string_view reliefTexture)
+{
+  return fullName.size() ==
+           surfaceTexture.size() + 1 + reliefTexture.size() &&
+         fullName.substr(0, surfaceTexture.size()) == surfaceTexture &&
+         fullName[surfaceTexture.size()] == '\n' &&
+         fullName.substr(surfaceTexture.size() + 1) == reliefTexture;
+}
+
+static string
+shaderSourcePath(string_view name, string_view extension)
+{
+  string path = "shaders/";
+  path += name;
+  path += extension;
+  return path;
+}
+
+/// Estimated bytes of a linked program, the driver does not tell its real size
+static size_t
+shaderProgramBytes(const ShaderProgram& program)
+{
+  int length = 0;
+  if (GLEW_ARB_get_program_binary) {
+    glGetProgramiv(
+      program.shaderProgramId(), GL_PROGRAM_BINARY_LENGTH, &length);
+  }
+  return length > 0 ? length : 64 * 1024;
+}
+
 ResourcePool::ResourcePool()
   : mShaderPool(new ShaderPool())
   , mTexturePool(new TexturePool())
+  , mFileWatcher(new FileWatcher())
 {}
 
 ResourcePool::~ResourcePool()
 {
+  delete mFileWatcher;
   delete mTexturePool;
   delete mShaderPool;
 }
 
-std::shared_ptr<ShaderProgram>
-ResourcePool::getShaderProgram(const std::string& name)
+template<class T, class MATCHES, class LOADER>
+Handle<T>
+ResourcePool::mAcquire(EntryTable<T>& table,
+                       NameTable<T>&  names,
+                       uint64_t       nameHash,
+                       MATCHES        matches,
+                       LOADER         load)
+{
+  PoolEntry<T>* entry = nullptr;
+  Handle<T>     handle;
+  for (auto [it, last] = names.equal_range(nameHash); it != last; ++it) {
+    auto candidate = table.get(it->second);
+    if (matches(candidate->name)) {
+      entry  = candidate;
+      handle = it->second;
+      break;
+    }
+  }
+  if (!entry) {
+    auto [resource, name] = load();
+    if (mEvictedNames.erase(name)) {
+      ++mStats.reloads;
+    }
+    handle = table.insert({move(resource), move(name), nameHash});
+    names.emplace(nameHash, handle);
+    entry = table.get(handle);
+  }
+  ++entry->references;
+  entry->lastUsed = ++mUseCount;
+  return handle;
+}
+
+template<class T>
+bool
+ResourcePool::mRelease(EntryTable<T>& table, Handle<T> handle)
 {
-  return mShaderPool->get(name);
+  auto entry = table.get(handle);
+  if (!entry || entry->references == 0) {
+    return false;
+  }
+  entry->lastUsed = ++mUseCount;
+  return --entry->references == 0;
 }
-std::shared_ptr<Texture>
-ResourcePool::getTexture(const std::string& filePath)
+
+template<class T>
+void
+ResourcePool::mErase(EntryTable<T>& table,
+                     NameTable<T>&  names,
+                     Handle<T>      handle)
 {
-  return mTexturePool->get(filePath);
+  auto entry = table.get(handle);
+  for (auto [it, last] = names.equal_range(entry->nameHash); it != last;
+       ++it) {
+    if (it->second == handle) {
+      names.erase(it);
+      break;
+    }
+  }
+  table.erase(handle);
 }
 
-shared_ptr<Texture>
-TexturePool::get(const string& fileName)
+ShaderHandle
+ResourcePool::getShaderProgram(string_view name, const ShaderDefines& defines)
+{
+  auto nameHash = FNV_OFFSET_BASIS;
+  forEachShaderNamePiece(name, defines, [&](string_view piece) {
+    nameHash = fnv1a(piece, nameHash);
+  });
+  auto handle = mAcquire(
+    mShaderPrograms,
+    mShaderNames,
+    nameHash,
+    [&](const string& fullName) {
+      return matchesShaderName(fullName, name, defines);
+    },
+    [&] {
+      string fullName;
+      forEachShaderNamePiece(
+        name, defines, [&](string_view piece) { fullName += piece; });
+      auto preamble = fullName.substr(name.size() + 1);
+      auto program  = mShaderPool->load(string(name), preamble);
+      mWatch(shaderSourcePath(name, ".vert"));
+      mWatch(shaderSourcePath(name, ".frag"));
+      return make_pair(move(program), move(fullName));
+    });
+  auto entry = mShaderPrograms.get(handle);
+  if (!entry->bytes) {
+    entry->bytes = shaderProgramBytes(*entry->resource);
+  }
+  return handle;
+}
+
+TextureHandle
+ResourcePool::getTexture(string_view filePath)
+{
+  return mAcquire(
+    mTextures,
+    mTextureNames,
+    fnv1a(filePath),
+    [&](const string& name) { return name == filePath; },
+    [&] {
+      string name(filePath);
+      auto   texture = mTexturePool->load(name);
+      mWatch(name);
+      return make_pair(move(texture), move(name));
+    });
+}
+
+MaterialHandle
+ResourcePool::getMaterial(string_view surfaceTexture, string_view reliefTexture)
+{
+  return mAcquire(
+    mMaterials,
+    mMaterialNames,
+    fnv1a(reliefTexture, fnv1a("\n", fnv1a(surfaceTexture))),
+    [&](const string& name) {
+      return matchesMaterialName(name, surfaceTexture, reliefTexture);
+    },
+    [&] {
+      auto material = make_shared<Material>(
+        Material{getTexture(surfaceTexture), getTexture(reliefTexture)});
+      string name(surfaceTexture);
+      name += '\n';
+      name += reliefTexture;
+      return make_pair(move(material), move(name));
+    });
+}
+
+void
+ResourcePool::release(ShaderHandle handle)
+{
+  mRelease(mShaderPrograms, handle);
+}
+
+void
+ResourcePool::release(TextureHandle handle)
+{
+  mRelease(mTextures, handle);
+}
+
+void
+ResourcePool::release(MaterialHandle handle)
 {
-  auto texture = mTexturePool[fileName];
-  if (!texture) {
-    texture = mTexturePool[fileName] = make_shared<Texture>(fileName.c_str());
+  if (!mRelease(mMaterials, handle)) {
+    return;
   }
+  // Materials cost nothing on the GPU, only their textures are worth caching
+  auto entry = mMaterials.get(handle);
+  release(entry->resource->surfaceTexture);
+  release(entry->resource->reliefTexture);
+  mErase(mMaterials, mMaterialNames, handle);
+}
+
+void
+ResourcePool::update()
+{
+  for (auto& file : mFileWatcher->poll()) {
+    mHotReload(file);
+  }
+  auto& loader = mTexturePool->loader();
+  loader.processUploads(TEXTURE_UPLOAD_BUDGET);
+  mStats.textureReloadTime = loader.lastReloadTime();
+  mStats.textureLoadError  = loader.lastError();
+  mStats.textureCacheError = loader.lastCacheError();
+  mEvict();
+}
+
+void
+ResourcePool::mWatch(const string& file)
+{
+  // Archived files can not change
+  if (!findArchivedFile(file)) {
+    mFileWatcher->watch(file);
+  }
+}
+
+void
+ResourcePool::mHotReload(const string& file)
+{
+  mShaderPrograms.forEach(
+    [&](ShaderHandle, PoolEntry<ShaderProgram>& entry) {
+      auto name = string_view(entry.name).substr(0, entry.name.find('\n'));
+      if (file != shaderSourcePath(name, ".vert") &&
+          file != shaderSourcePath(name, ".frag")) {
+        return;
+      }
+      auto start = chrono::steady_clock::now();
+      try {
+        // The old program is kept if the new one does not compile
+        entry.resource =
+          mShaderPool->load(string(name), entry.name.substr(name.size() + 1));
+        entry.bytes = shaderProgramBytes(*entry.resource);
+        ++mStats.shaderHotReloads;
+        mStats.shaderReloadTime = chrono::duration<float, milli>(
+                                    chrono::steady_clock::now() - start)
+                                    .count();
+        mStats.hotReloadError.clear();
+      } catch (const exception& e) {
+        mStats.hotReloadError = file + ": " + e.what();
+      }
+    });
+  mTextures.forEach([&](TextureHandle, PoolEntry<Texture>& entry) {
+    if (FileWatcher::normalize(entry.name) == file) {
+      mTexturePool->loader().load(entry.name, entry.resource, true);
+      ++mStats.textureHotReloads;
+    }
+  });
+}
+
+void
+ResourcePool::mEvict()
+{
+  struct Candidate
+  {
+    uint64_t lastUsed;
+    bool     isTexture;
+    uint32_t handle;
+  };
+  vector<Candidate> candidates;
+
+  // Textures change size when their upload finishes, shaders never do
+  mStats.textureBytes = 0;
+  mTextures.forEach([&](TextureHandle handle, PoolEntry<Texture>& entry) {
+    entry.bytes = entry.resource->byteSize();
+    mStats.textureBytes += entry.bytes;
+    if (entry.references == 0) {
+      candidates.push_back({entry.lastUsed, true, handle.value});
+    }
+  });
+  mStats.shaderBytes = 0;
+  mShaderPrograms.forEach(
+    [&](ShaderHandle handle, PoolEntry<ShaderProgram>& entry) {
+      mStats.shaderBytes += entry.bytes;
+      if (entry.references == 0) {
+        candidates.push_back({entry.lastUsed, false, handle.value});
+      }
+    });
+
+  auto used = mStats.textureBytes + mStats.shaderBytes;
+  if (used <= mBudget) {
+    return;
+  }
+  sort(candidates.begin(), candidates.end(), [](auto& lhs, auto& rhs) {
+    return lhs.lastUsed < rhs.lastUsed;
+  });
+  for (auto& candidate : candidates) {
+    if (used <= mBudget) {
+      break;
+    }
+    if (candidate.isTexture) {
+      auto handle = TextureHandle{candidate.handle};
+      auto entry  = mTextures.get(handle);
+      used -= entry->bytes;
+      mStats.textureBytes -= entry->bytes;
+      mEvictedNames.insert(entry->name);
+      mErase(mTextures, mTextureNames, handle);
+    } else {
+      auto handle = ShaderHandle{candidate.handle};
+      auto entry  = mShaderPrograms.get(handle);
+      used -= entry->bytes;
+      mStats.shaderBytes -= entry->bytes;
+      mEvictedNames.insert(entry->name);
+      mErase(mShaderPrograms, mShaderNames, handle);
+    }
+    ++mStats.evictions;
+  }
+}
+
+void
+ResourcePool::finishLoading()
+{
+  mTexturePool->loader().finish();
+}
+
+unsigned
+ResourcePool::pendingTextures() const
+{
+  return mTexturePool->loader().pending();
+}
+
+shared_ptr<Texture>
+TexturePool::load(const string& fileName)
+{
+  // Flat normal, no depth, so it works as both surface and relief
+  static unsigned char placeholder[] = {128, 128, 255, 255};
+  auto                 texture       = make_shared<Texture>();
+  texture->updateTexture(placeholder, 1, 1);
+  mLoader.load(fileName, texture);
   return texture;
 }
 
+ShaderPool::ShaderPool()
+{
+  mDriverHash = FNV_OFFSET_BASIS;
+  for (auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    if (auto value = glGetString(name)) {
+      mDriverHash = fnv1a(reinterpret_cast<const char*>(value), mDriverHash);
+    }
+  }
+}
+
 shared_ptr<ShaderProgram>
-ShaderPool::get(const string& name)
+ShaderPool::load(const string& name, const string& preamble)
+{
+  auto vertexName   = shaderSourcePath(name, ".vert");
+  auto fragmentName = shaderSourcePath(name, ".frag");
+
+  MappedFile vertexSource(vertexName.c_str());
+  MappedFile fragmentSource(fragmentName.c_str());
+  auto       binaryPath =
+    mBinaryPath(name, preamble, vertexSource.view(), fragmentSource.view());
+  if (auto program = mLoadBinary(binaryPath)) {
+    return program;
+  }
+
+  // The stages are dropped once linked, the program keeps what it needs
+  auto vertexShader =
+    Shader::fromSource(ShaderType::VERTEX, vertexSource.view(), preamble);
+  auto fragmentShader =
+    Shader::fromSource(ShaderType::FRAGMENT, fragmentSource.view(), preamble);
+  auto program = make_shared<ShaderProgram>(vertexShader, fragmentShader);
+  mSaveBinary(binaryPath, *program);
+  return program;
+}
+
+string
+ShaderPool::mBinaryPath(const string& name,
+                        string_view   preamble,
+                        string_view   vertexSource,
+                        string_view   fragmentSource) const
 {
-  shared_ptr<ShaderProgram> program = mProgramPool[name];
-  if (!program) {
-    string vertexName   = "shaders/" + name + ".vert";
-    string fragmentName = "shaders/" + name + ".frag";
+  // The permutation is part of the name, so cleaning older binaries of one
+  // permutation leaves the others alone
+  auto permutationHash = uint32_t(fnv1a(preamble));
+  auto hash = fnv1a(fragmentSource, fnv1a(vertexSource, mDriverHash));
+  char hashText[26];
+  snprintf(hashText,
+           sizeof(hashText),
+           "%08x-%016llx",
+           permutationHash,
+           (unsigned long long)hash);
+  return SHADER_CACHE_DIR + name + "-" + hashText + ".bin";
+}
 
-    shared_ptr<Shader> vertexShader = mShaderPool[vertexName];
-    if (!vertexShader) {
-      mShaderPool[vertexName] = vertexShader = make_shared<Shader>(
-        Shader::fromFilePath(ShaderType::VERTEX, vertexName.c_str()));
+shared_ptr<ShaderProgram>
+ShaderPool::mLoadBinary(const string& path) const
+{
+  if (!GLEW_ARB_get_program_binary || !filesystem::exists(path)) {
+    return nullptr;
+  }
+  try {
+    MappedFile binaryFile(path.c_str());
+    auto       binary = binaryFile.view();
+    uint32_t   format;
+    if (binary.size() <= sizeof(format)) {
+      return nullptr;
     }
+    memcpy(&format, binary.data(), sizeof(format));
+    return make_shared<ShaderProgram>(
+      ShaderProgram::fromBinary(format, binary.substr(sizeof(format))));
+  } catch (const exception&) {
+    // Stale or corrupt, it is going to be overwritten
+    return nullptr;
+  }
+}
 
-    shared_ptr<Shader> fragmentShader = mShaderPool[fragmentName];
-    if (!fragmentShader) {
-      mShaderPool[fragmentName] = fragmentShader = make_shared<Shader>(
-        Shader::fromFilePath(ShaderType::FRAGMENT, fragmentName.c_str()));
+void
+ShaderPool::mSaveBinary(const string& path, const ShaderProgram& program) const
+{
+  unsigned format;
+  auto     binary = program.binary(&format);
+  if (binary.empty()) {
+    return;
+  }
+  error_code ec;
+  filesystem::create_directories(SHADER_CACHE_DIR, ec);
+  // Drop binaries from older versions of this program
+  auto fileName = filesystem::path(path).filename().string();
+  auto prefix   = fileName.substr(0, fileName.rfind('-') + 1);
+  for (auto& entry : filesystem::directory_iterator(SHADER_CACHE_DIR, ec)) {
+    auto entryName = entry.path().filename().string();
+    if (entryName != fileName &&
+        entryName.compare(0, prefix.size(), prefix) == 0) {
+      filesystem::remove(entry.path(), ec);
     }
-    mProgramPool[name] = program =
-      make_shared<ShaderProgram>(*vertexShader, *fragmentShader);
   }
-  return program;
+  ofstream output(path, ios::binary);
+  uint32_t storedFormat = format;
+  output.write(reinterpret_cast<const char*>(&storedFormat),
+               sizeof(storedFormat));
+  output.write(binary.data(), binary.size());
 }
@@ -1,15 +1,83 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "ResourceHandle.hpp"
 
 // Forward declaration
-class ShaderProgram;
-class Texture;
+class FileWatcher;
 class ShaderPool;
 class TexturePool;
 
+/**
+ * @brief Preprocessor definitions for a shader permutation, as name and value
+ *
+ */
+using ShaderDefines = std::vector<std::pair<std::string, int>>;
+
+/**
+ * @brief A surface texture paired with its relief map
+ *
+ */
+struct Material
+{
+  TextureHandle surfaceTexture;
+  TextureHandle reliefTexture;
+};
+
+/**
+ * @brief A pooled resource and its bookkeeping
+ *
+ */
+template<class T>
+struct PoolEntry
+{
+  std::shared_ptr<T> resource;
+  std::string        name;
+  uint64_t           nameHash   = 0;
+  unsigned           references = 0;
+  std::size_t        bytes      = 0;
+  uint64_t           lastUsed   = 0;
+};
+
+/**
+ * @brief Memory accounting of a ResourcePool
+ *
+ */
+struct ResourceStats
+{
+  std::size_t textureBytes      = 0;
+  std::size_t shaderBytes       = 0;
+  unsigned    evictions         = 0;
+  unsigned    reloads           = 0;
+  unsigned    shaderHotReloads  = 0;
+  unsigned    textureHotReloads = 0;
+  /// Milliseconds of the last hot reload, from the change to the swap
+  float       shaderReloadTime  = 0;
+  float       textureReloadTime = 0;
+  std::string hotReloadError;
+  /// The last texture that failed to load, it keeps its placeholder
+  std::string textureLoadError;
+  /// The last cooked texture that was unreadable, the source is used instead
+  std::string textureCacheError;
+};
+
 /**
  * @brief A general Resource Pool containing other resource pools
  *
+ * Resources are owned by the pool and referred by handles, which are cheap to
+ * copy and resolve. Each get*() call adds a reference that must be given back
+ * with release(). Unreferenced resources stay cached until the estimated GPU
+ * memory goes over budget(), then the least recently released are evicted.
+ *
+ * Source files read from disk are watched. When they change update() swaps in
+ * the recompiled or redecoded resource behind the same handle.
  */
 class ResourcePool
 {
@@ -18,20 +86,87 @@ public:
   ~ResourcePool();
 
   /**
-   * @brief Get the Shader Program object
+   * @brief Get the Shader Program handle
    *
    * @param name the shader name. It will try to load if necessary.
-   * @return std::shared_ptr<ShaderProgram>
+   * @param defines the permutation to use. They are defined right after the
+   * #version line of both shaders. Each distinct set is a distinct program.
+   * @return ShaderHandle
    */
-  std::shared_ptr<ShaderProgram> getShaderProgram(const std::string& name);
+  ShaderHandle getShaderProgram(std::string_view     name,
+                                const ShaderDefines& defines = {});
 
   /**
-   * @brief Get the Texture object
+   * @brief Get the Texture handle
+   *
+   * The texture is decoded in background, it shows a placeholder until
+   * update() uploads it.
    *
    * @param filePath the path to the texture
-   * @return std::shared_ptr<Texture>
+   * @return TextureHandle
+   */
+  TextureHandle getTexture(std::string_view filePath);
+
+  /**
+   * @brief Get the Material handle
+   *
+   * @param surfaceTexture the path to the surface texture
+   * @param reliefTexture the path to the relief texture
+   * @return MaterialHandle
    */
-  std::shared_ptr<Texture> getTexture(const std::string& filePath);
+  MaterialHandle getMaterial(std::string_view surfaceTexture,
+                             std::string_view reliefTexture);
+
+  /**
+   * @brief Give back a reference obtained with a get*() call
+   *
+   */
+  void release(ShaderHandle handle);
+  void release(TextureHandle handle);
+  void release(MaterialHandle handle);
+
+  ShaderProgram* shaderProgram(ShaderHandle handle) const
+  {
+    auto entry = mShaderPrograms.get(handle);
+    return entry ? entry->resource.get() : nullptr;
+  }
+
+  Texture* texture(TextureHandle handle) const
+  {
+    auto entry = mTextures.get(handle);
+    return entry ? entry->resource.get() : nullptr;
+  }
+
+  const Material* material(MaterialHandle handle) const
+  {
+    auto entry = mMaterials.get(handle);
+    return entry ? entry->resource.get() : nullptr;
+  }
+
+  /**
+   * @brief Estimated GPU bytes kept before evicting unreferenced resources
+   *
+   */
+  std::size_t budget() const { return mBudget; }
+  void        budget(std::size_t bytes) { mBudget = bytes; }
+
+  const ResourceStats& stats() const { return mStats; }
+
+  /**
+   * @brief Upload a bounded amount of loaded resources, hot reload changed
+   * files and evict if over budget
+   *
+   * Call it once per frame, from the render thread.
+   */
+  void update();
+
+  /**
+   * @brief Block until every requested resource is uploaded
+   *
+   */
+  void finishLoading();
+
+  unsigned pendingTextures() const;
 
   // Operational stuff
   ResourcePool(const ResourcePool&) = delete;
@@ -40,6 +175,42 @@ public:
   ResourcePool& operator=(ResourcePool&&) = delete;
 
 private:
-  ShaderPool*  mShaderPool;
-  TexturePool* mTexturePool;
+  template<class T>
+  using EntryTable = HandleTable<PoolEntry<T>, T>;
+
+  /// Keyed by the name hash, so a hit does not need to build the name
+  template<class T>
+  using NameTable = std::unordered_multimap<uint64_t, Handle<T>>;
+
+  template<class T, class MATCHES, class LOADER>
+  Handle<T> mAcquire(EntryTable<T>& table,
+                     NameTable<T>&  names,
+                     uint64_t       nameHash,
+                     MATCHES        matches,
+                     LOADER         load);
+
+  template<class T>
+  bool mRelease(EntryTable<T>& table, Handle<T> handle);
+
+  template<class T>
+  void mErase(EntryTable<T>& table, NameTable<T>& names, Handle<T> handle);
+
+  void mWatch(const std::string& file);
+  void mHotReload(const std::string& file);
+  void mEvict();
+
+private:
+  EntryTable<ShaderProgram>       mShaderPrograms;
+  EntryTable<Texture>             mTextures;
+  EntryTable<Material>            mMaterials;
+  NameTable<ShaderProgram>        mShaderNames;
+  NameTable<Texture>              mTextureNames;
+  NameTable<Material>             mMaterialNames;
+  std::unordered_set<std::string> mEvictedNames;
+  uint64_t                        mUseCount = 0;
+  std::size_t                     mBudget   = 256 << 20;
+  ResourceStats                   mStats;
+  ShaderPool*                     mShaderPool;
+  TexturePool*                    mTexturePool;
+  FileWatcher*                    mFileWatcher;
 };
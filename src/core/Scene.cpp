@@ -19,6 +19,18 @@ Scene::update(float delta) const
   }
 }
 
+void
+Scene::setVoxel(const glm::ivec3& pos, unsigned blockType)
+{
+  mDetail->setVoxel(pos, blockType);
+}
+
+unsigned
+Scene::voxel(const glm::ivec3& pos) const
+{
+  return mDetail->chunk.at(pos).blockType;
+}
+
 void
 Scene::insertComponent(std::shared_ptr<SceneComponent> component)
 {
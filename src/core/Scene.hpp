@@ -36,6 +36,24 @@ public:
    */
   void update(float delta) const;
 
+  /**
+   * @brief Change a single voxel
+   *
+   * Dirty region subscribers are notified before it returns.
+   *
+   * @param pos the voxel position, in world coordinates
+   * @param blockType the new block type, or NO_BLOCK to clear it
+   */
+  void setVoxel(const glm::ivec3& pos, unsigned blockType);
+
+  /**
+   * @brief Get a voxel type
+   *
+   * @param pos the voxel position, in world coordinates
+   * @return unsigned the block type
+   */
+  unsigned voxel(const glm::ivec3& pos) const;
+
   void insertComponent(std::shared_ptr<SceneComponent> component);
   void eraseComponent(const std::shared_ptr<SceneComponent>& component);
 
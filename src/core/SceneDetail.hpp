@@ -1,5 +1,8 @@
 #pragma once
+#include <memory>
 #include "Chunk.hpp"
+#include "ChunkPyramid.hpp"
+#include "DirtyRegion.hpp"
 
 class BasicCamera;
 
@@ -9,10 +12,96 @@ class BasicCamera;
  */
 struct SceneDetail
 {
-  BasicCamera* camera;
-  Chunk        chunk;
+  BasicCamera*         camera;
+  Chunk                chunk;
+  ChunkPyramid         pyramid;
+  DirtyRegionPublisher dirtyRegions;
+  /// Changes on each clipmap, in world voxels, see markClipmapDirty()
+  DirtyRegionPublisher clipmapRegions[CLIPMAP_LEVELS];
 
   SceneDetail(BasicCamera* camera)
     : camera(camera)
+    , pyramid(chunk)
   {}
+
+  /**
+   * @brief Subscribe to changes on the chunk content
+   *
+   * @param listener called after each change
+   * @return unsigned the subscription id
+   */
+  unsigned subscribeDirty(DirtyRegionListener listener)
+  {
+    return dirtyRegions.subscribe(std::move(listener));
+  }
+
+  void unsubscribeDirty(unsigned id) { dirtyRegions.unsubscribe(id); }
+
+  /**
+   * @brief Notify the region [lowerBound, higherBound) was rewritten
+   *
+   * Anyone writing directly into the chunk must call this afterwards. The
+   * pyramid is brought up to date before the listeners are called.
+   */
+  void markDirty(const glm::ivec3& lowerBound, const glm::ivec3& higherBound)
+  {
+    pyramid.update({lowerBound, higherBound});
+    dirtyRegions.publish({lowerBound, higherBound});
+  }
+
+  /**
+   * @brief The chunk of a clipmap level, allocated on first use
+   *
+   * Its cells have 2^level voxels of side and wrap like the chunk ones, so
+   * the level covers CHUNK_SIDE << level voxels around the camera.
+   *
+   * @param level from 1 to CLIPMAP_LEVELS, 0 is the chunk itself
+   */
+  Chunk& clipmap(unsigned level)
+  {
+    if (level == 0) {
+      return chunk;
+    }
+    auto& cells = mClipmaps[level - 1];
+    if (!cells) {
+      cells = std::make_unique<Chunk>();
+    }
+    return *cells;
+  }
+
+  /**
+   * @brief Notify the cells [lowerCell, higherCell) of a clipmap were rewritten
+   *
+   * The listeners get the region in world voxels.
+   */
+  void markClipmapDirty(unsigned          level,
+                        const glm::ivec3& lowerCell,
+                        const glm::ivec3& higherCell)
+  {
+    if (level == 0) {
+      markDirty(lowerCell, higherCell);
+      return;
+    }
+    clipmapRegions[level - 1].publish(
+      {lowerCell * (1 << level), higherCell * (1 << level)});
+  }
+
+  /**
+   * @brief Change a single voxel and notify it
+   *
+   * @param pos the voxel world position
+   * @param blockType the new type
+   */
+  void setVoxel(const glm::ivec3& pos, unsigned blockType)
+  {
+    auto& voxel = chunk.at(pos);
+    if (voxel.blockType == blockType) {
+      return;
+    }
+    voxel.blockType = blockType;
+    markDirty(pos, pos + glm::ivec3(1));
+  }
+
+private:
+  std::unique_ptr<Chunk> mClipmaps[CLIPMAP_LEVELS];
 };
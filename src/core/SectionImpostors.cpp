@@ -0,0 +1,235 @@
+#include "SectionImpostors.hpp"
+#include <cmath>
+#include <cstddef>
+#include <GL/glew.h>
+#include <glm/gtx/transform.hpp>
+
+using namespace std;
+
+/// Snapshots on each row of the atlas, and rows
+constexpr int IMPOSTOR_SLOTS_PER_ROW = IMPOSTOR_ATLAS_SIZE / IMPOSTOR_SIZE;
+
+/**
+ * @brief The radius of the sphere around a section, what a snapshot frames
+ *
+ */
+inline float
+boundingRadius(const DirtyRegion& bounds)
+{
+  return glm::length(glm::vec3(bounds.higherBound - bounds.lowerBound)) / 2;
+}
+
+inline glm::vec3
+boundingCenter(const DirtyRegion& bounds)
+{
+  return glm::vec3(bounds.lowerBound + bounds.higherBound) / 2.f;
+}
+
+/**
+ * @brief The up vector of a snapshot, anything not along its direction
+ *
+ */
+inline glm::vec3
+snapshotUp(const glm::vec3& direction)
+{
+  return abs(direction.z) > .99f ? glm::vec3(0, 1, 0) : glm::vec3(0, 0, 1);
+}
+
+SectionImpostors::SectionImpostors()
+  : mAtlas(IMPOSTOR_ATLAS_SIZE,
+           IMPOSTOR_ATLAS_SIZE,
+           vector<unsigned>{GL_RGBA8, GL_RGBA8})
+{
+  for (int slot = IMPOSTOR_SLOTS_PER_ROW * IMPOSTOR_SLOTS_PER_ROW - 1;
+       slot >= 0;
+       --slot) {
+    mFreeSlots.push_back(slot);
+  }
+  glGenBuffers(1, &mVbo);
+}
+
+SectionImpostors::~SectionImpostors()
+{
+  glDeleteBuffers(1, &mVbo);
+}
+
+bool
+SectionImpostors::add(uint64_t          key,
+                      const SectionMesh& mesh,
+                      const glm::vec3&   cameraPos)
+{
+  auto& impostor   = mImpostors[key];
+  int   side       = SECTION_SIDE << mesh.clipmapLevel;
+  impostor.bounds  = {mesh.lowerBound, mesh.lowerBound + side};
+  impostor.lastUse = mFrame;
+  auto center      = boundingCenter(impostor.bounds);
+  impostor.wanted  = glm::normalize(center - cameraPos);
+  bool drifted =
+    glm::dot(impostor.wanted, impostor.direction) < cos(IMPOSTOR_MAX_DRIFT);
+  if ((impostor.stale || drifted) && !impostor.queued) {
+    impostor.queued = true;
+    mQueue.push_back(key);
+  }
+  if (impostor.slot < 0) {
+    return false;
+  }
+  // The plane through the center the snapshot was projected on
+  float radius    = boundingRadius(impostor.bounds);
+  auto& direction = impostor.direction;
+  auto  right =
+    glm::normalize(glm::cross(direction, snapshotUp(direction))) * radius;
+  auto  up     = glm::cross(right, direction);
+  float size   = 1.f / IMPOSTOR_SLOTS_PER_ROW;
+  float lowerR = impostor.slot % IMPOSTOR_SLOTS_PER_ROW * size;
+  float lowerS = impostor.slot / IMPOSTOR_SLOTS_PER_ROW * size;
+  auto  corner = [&](float x, float y) {
+    auto position = center + right * x + up * y;
+    mVertices.push_back({position.x,
+                         position.y,
+                         position.z,
+                         lowerR + (x + 1) / 2 * size,
+                         lowerS + (y + 1) / 2 * size});
+  };
+  corner(-1, -1);
+  corner(1, -1);
+  corner(-1, 1);
+  corner(-1, 1);
+  corner(1, -1);
+  corner(1, 1);
+  return true;
+}
+
+void
+SectionImpostors::draw()
+{
+  if (mVertices.empty()) {
+    return;
+  }
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, mAtlas.colorTexture(0));
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, mAtlas.colorTexture(1));
+  glActiveTexture(GL_TEXTURE0);
+
+  glBindBuffer(GL_ARRAY_BUFFER, mVbo);
+  glBufferData(GL_ARRAY_BUFFER,
+               mVertices.size() * sizeof(Vertex),
+               mVertices.data(),
+               GL_STREAM_DRAW);
+
+  // position attribute
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+  glEnableVertexAttribArray(0);
+
+  // texture attribute, at the same location as VoxelModel
+  glVertexAttribPointer(
+    2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texR));
+  glEnableVertexAttribArray(2);
+
+  // The VAO is shared, sections and voxels leave these on their own buffers
+  for (unsigned attribute : {1, 3, 4}) {
+    glDisableVertexAttribArray(attribute);
+  }
+
+  glDrawArrays(GL_TRIANGLES, 0, mVertices.size());
+  mVertices.clear();
+}
+
+void
+SectionImpostors::invalidate(const DirtyRegion& region)
+{
+  for (auto& [key, impostor] : mImpostors) {
+    if (region.intersects(impostor.bounds)) {
+      impostor.stale = true;
+    }
+  }
+}
+
+void
+SectionImpostors::mStartFrame()
+{
+  ++mFrame;
+  mVertices.clear();
+  for (auto it = mImpostors.begin(); it != mImpostors.end();) {
+    if (mFrame - it->second.lastUse > IMPOSTOR_IDLE_FRAMES) {
+      if (it->second.slot >= 0) {
+        mFreeSlots.push_back(it->second.slot);
+      }
+      it = mImpostors.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool
+SectionImpostors::mAllocate(Impostor& impostor)
+{
+  if (mFreeSlots.empty()) {
+    // Drawn least recently, and not on the last frame
+    Impostor* oldest = nullptr;
+    for (auto& [key, other] : mImpostors) {
+      if (other.slot >= 0 && other.lastUse + 1 < mFrame &&
+          (!oldest || other.lastUse < oldest->lastUse)) {
+        oldest = &other;
+      }
+    }
+    if (!oldest) {
+      return false;
+    }
+    mFreeSlots.push_back(oldest->slot);
+    oldest->slot  = -1;
+    oldest->stale = true;
+  }
+  impostor.slot = mFreeSlots.back();
+  mFreeSlots.pop_back();
+  return true;
+}
+
+bool
+SectionImpostors::mBeginCapture(Impostor&     impostor,
+                                bool          first,
+                                ImpostorView& view)
+{
+  if (impostor.slot < 0 && !mAllocate(impostor)) {
+    return false;
+  }
+  if (first) {
+    mAtlas.bind();
+    // Alpha must stay as written, zero marks the empty pixels
+    mBlending = glIsEnabled(GL_BLEND);
+    glDisable(GL_BLEND);
+    glEnable(GL_SCISSOR_TEST);
+  }
+  int x = impostor.slot % IMPOSTOR_SLOTS_PER_ROW * IMPOSTOR_SIZE;
+  int y = impostor.slot / IMPOSTOR_SLOTS_PER_ROW * IMPOSTOR_SIZE;
+  glViewport(x, y, IMPOSTOR_SIZE, IMPOSTOR_SIZE);
+  glScissor(x, y, IMPOSTOR_SIZE, IMPOSTOR_SIZE);
+  float clearColor[4] = {0, 0, 0, 0};
+  float clearDepth    = 1;
+  glClearBufferfv(GL_COLOR, 0, clearColor);
+  glClearBufferfv(GL_COLOR, 1, clearColor);
+  glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+
+  auto  center    = boundingCenter(impostor.bounds);
+  float radius    = boundingRadius(impostor.bounds);
+  auto& direction = impostor.wanted;
+  view.view =
+    glm::lookAt(center - direction * radius, center, snapshotUp(direction));
+  view.projection =
+    glm::ortho(-radius, radius, -radius, radius, 0.f, 2 * radius);
+  impostor.direction = direction;
+  impostor.stale     = false;
+  ++mCaptures;
+  return true;
+}
+
+void
+SectionImpostors::mEndCapture()
+{
+  glDisable(GL_SCISSOR_TEST);
+  if (mBlending) {
+    glEnable(GL_BLEND);
+  }
+  FrameBuffer::unbind();
+}
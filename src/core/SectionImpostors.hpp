@@ -0,0 +1,150 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "DirtyRegion.hpp"
+#include "FrameBuffer.hpp"
+#include "SectionMeshComponent.hpp"
+
+/// Side of the atlas, in pixels
+constexpr int IMPOSTOR_ATLAS_SIZE = 2048;
+/// Side of a snapshot in the atlas, in pixels
+constexpr int IMPOSTOR_SIZE = 128;
+/// Snapshots taken per frame, the sections waiting are drawn from their mesh
+constexpr unsigned IMPOSTOR_CAPTURES_PER_FRAME = 4;
+/// How far the view direction may turn, in radians, before a retake
+constexpr float IMPOSTOR_MAX_DRIFT = .05f;
+/// Frames a snapshot is kept without being drawn
+constexpr unsigned IMPOSTOR_IDLE_FRAMES = 600;
+
+/**
+ * @brief The camera a snapshot is taken with, in world space
+ *
+ */
+struct ImpostorView
+{
+  glm::mat4 view;
+  glm::mat4 projection;
+};
+
+/**
+ * @brief Snapshots of distant sections, drawn as one quad each
+ *
+ * A snapshot looks at the section along the direction from the camera, with
+ * an orthographic projection framing its bounding sphere. Like the gBuffer,
+ * it keeps the albedo and the normal, in world space here, so the quad is lit
+ * as the mesh would be.
+ *
+ * It is reused until the section is rebuilt or the direction from the camera
+ * turns past IMPOSTOR_MAX_DRIFT. The retake is queued for a later frame, and
+ * the old snapshot is drawn meanwhile. When the atlas is full, the snapshot
+ * drawn least recently is evicted.
+ */
+class SectionImpostors
+{
+public:
+  SectionImpostors();
+  ~SectionImpostors();
+  SectionImpostors(const SectionImpostors&) = delete;
+  SectionImpostors(SectionImpostors&&)      = delete;
+  SectionImpostors& operator=(const SectionImpostors&) = delete;
+  SectionImpostors& operator=(SectionImpostors&&) = delete;
+
+  /**
+   * @brief Start a frame, taking up to IMPOSTOR_CAPTURES_PER_FRAME snapshots
+   *
+   * It changes the framebuffer binding and viewport.
+   *
+   * @param meshes where the queued sections are
+   * @param draw called with each mesh and the ImpostorView to draw it with,
+   * it must write the albedo and the world space normal
+   */
+  template<class CALLBACK>
+  void capture(const SectionMeshComponent& meshes, CALLBACK draw)
+  {
+    mStartFrame();
+    unsigned taken = 0;
+    while (!mQueue.empty() && taken < IMPOSTOR_CAPTURES_PER_FRAME) {
+      auto key = mQueue.front();
+      mQueue.pop_front();
+      auto impostor = mImpostors.find(key);
+      auto mesh     = meshes.sections.find(key);
+      if (impostor == mImpostors.end()) {
+        continue;
+      }
+      impostor->second.queued = false;
+      if (mesh == meshes.sections.end() || !mesh->second.indexCount) {
+        continue;
+      }
+      ImpostorView view;
+      if (!mBeginCapture(impostor->second, taken == 0, view)) {
+        break;
+      }
+      draw(mesh->second, view);
+      ++taken;
+    }
+    if (taken) {
+      mEndCapture();
+    }
+  }
+
+  /**
+   * @brief Add the quad of a section to this frame
+   *
+   * @return false if it has no snapshot yet, its mesh must be drawn instead
+   */
+  bool add(uint64_t key, const SectionMesh& mesh, const glm::vec3& cameraPos);
+
+  /**
+   * @brief Draw the quads added this frame, with the current program
+   *
+   * The albedo is bound to unit 0 and the normal to unit 1.
+   */
+  void draw();
+
+  /**
+   * @brief Retake the snapshots of the sections intersecting the region
+   *
+   */
+  void invalidate(const DirtyRegion& region);
+
+  /// Snapshots taken since created
+  unsigned captures() const { return mCaptures; }
+
+private:
+  struct Impostor
+  {
+    DirtyRegion bounds;
+    /// From the camera to the center, when taken and when last added
+    glm::vec3 direction{0};
+    glm::vec3 wanted{0};
+    int       slot    = -1;
+    unsigned  lastUse = 0;
+    bool      stale   = true;
+    bool      queued  = false;
+  };
+
+  struct Vertex
+  {
+    float x, y, z;
+    float texR, texS;
+  };
+
+  void mStartFrame();
+  bool mBeginCapture(Impostor& impostor, bool first, ImpostorView& view);
+  void mEndCapture();
+  bool mAllocate(Impostor& impostor);
+
+private:
+  FrameBuffer                            mAtlas;
+  std::unordered_map<uint64_t, Impostor> mImpostors;
+  std::deque<uint64_t>                   mQueue;
+  std::vector<int>                       mFreeSlots;
+  std::vector<Vertex>                    mVertices;
+  unsigned                               mVbo      = 0;
+  unsigned                               mFrame    = 0;
+  unsigned                               mCaptures = 0;
+  bool                                   mBlending = false;
+};
@@ -0,0 +1,485 @@
+#include "SectionMeshComponent.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <GL/glew.h>
+#include "Camera.hpp"
+#include "SceneDetail.hpp"
+#include "VoxelModel.hpp"
+
+using namespace std;
+
+struct SectionVertex
+{
+  float x, y, z;
+  float normalX, normalY, normalZ;
+  float texR, texS;
+  float occlusion;
+};
+
+/// The voxel hiding each face, in VoxelFace bit order
+static const glm::ivec3 faceNeighbours[] = {
+  {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
+
+/// The two triangles of a face, from its strip order, split along 1-2
+static const unsigned faceIndexes[] = {0, 1, 2, 2, 1, 3};
+/// The same, split along 0-3
+static const unsigned flippedFaceIndexes[] = {0, 1, 3, 0, 3, 2};
+
+/// Light by the number of voxels around a vertex, see vertexOcclusion()
+static const float occlusionLight[] = {
+  1.f, 1.f - (1.f - AO_MIN_LIGHT) / 3, 1.f - (1.f - AO_MIN_LIGHT) * 2 / 3,
+  AO_MIN_LIGHT};
+
+/**
+ * @brief A face corner, with the voxels that occlude it
+ *
+ * The occluders are relative to the voxel owning the face, both sides and the
+ * diagonal, in the layer in front of the face.
+ */
+struct MeshCorner
+{
+  FaceVertex vertex;
+  glm::ivec3 occluders[3];
+};
+
+/// Per face, in VoxelFace bit order, and corner, in strip order
+using MeshCorners = MeshCorner[6][4];
+
+static const MeshCorners&
+meshCorners()
+{
+  static MeshCorners corners;
+  static bool        baked = false;
+  if (baked) {
+    return corners;
+  }
+  for (unsigned face = 0; face < 6; ++face) {
+    for (unsigned i = 0; i < 4; ++i) {
+      auto& corner  = corners[face][i];
+      corner.vertex = faceVertex(face, i);
+      // Corners are at +-.5, so this is the diagonal one
+      glm::ivec3 diagonal(glm::round(corner.vertex.position * 2.f));
+      glm::ivec3 side1(0), side2(0);
+      for (int axis = 0, sides = 0; axis < 3; ++axis) {
+        if (faceNeighbours[face][axis] == 0) {
+          (sides++ ? side2 : side1)[axis] = diagonal[axis];
+        }
+      }
+      corner.occluders[0] = faceNeighbours[face] + side1;
+      corner.occluders[1] = faceNeighbours[face] + side2;
+      corner.occluders[2] = diagonal;
+    }
+  }
+  baked = true;
+  return corners;
+}
+
+/// Distance past a LOD threshold before a section changes level
+constexpr float LOD_MARGIN = 4.f;
+
+/**
+ * @brief The number of cells occluding a corner, 0 to 3
+ *
+ * With both sides taken the diagonal is hidden, so it counts as fully occluded.
+ *
+ * @param blockAt gives the block type of a cell, of the level being meshed
+ */
+template<class BLOCK_AT>
+inline unsigned
+vertexOcclusion(BLOCK_AT          blockAt,
+                const glm::ivec3& cell,
+                const MeshCorner& corner)
+{
+  bool side1    = blockAt(cell + corner.occluders[0]) != NO_BLOCK;
+  bool side2    = blockAt(cell + corner.occluders[1]) != NO_BLOCK;
+  bool diagonal = blockAt(cell + corner.occluders[2]) != NO_BLOCK;
+  if (side1 && side2) {
+    return 3;
+  }
+  return side1 + side2 + diagonal;
+}
+
+/**
+ * @brief If the section is inside the ring its level holds around the camera
+ *
+ */
+inline bool
+isInsideRing(const SectionMesh& mesh, const glm::vec3& cameraPos)
+{
+  return sectionRing(mesh.clipmapLevel, cameraPos).contains(mesh.lowerBound);
+}
+
+/// Side of the sections of a clipmap level, in voxels
+inline int
+sectionSide(unsigned clipmapLevel)
+{
+  return SECTION_SIDE << clipmapLevel;
+}
+
+static void
+deleteBuffers(SectionMesh& mesh)
+{
+  if (mesh.vbo) {
+    glDeleteBuffers(1, &mesh.vbo);
+    glDeleteBuffers(1, &mesh.ebo);
+    mesh.vbo = mesh.ebo = 0;
+  }
+  mesh.indexCount = 0;
+  mesh.ranges.clear();
+}
+
+SectionMeshComponent::~SectionMeshComponent()
+{
+  for (auto& [key, mesh] : sections) {
+    deleteBuffers(mesh);
+  }
+}
+
+void
+SectionMeshComponent::onAttach(SceneDetail* scene)
+{
+  mSubscription = scene->subscribeDirty(
+    [this](const DirtyRegion& region) { mMarkDirty(region, 0); });
+  for (unsigned i = 0; i < CLIPMAP_LEVELS; ++i) {
+    mClipmapSubscriptions[i] = scene->clipmapRegions[i].subscribe(
+      [this, i](const DirtyRegion& region) { mMarkDirty(region, i + 1); });
+  }
+}
+
+void
+SectionMeshComponent::onDetach(SceneDetail* scene)
+{
+  scene->unsubscribeDirty(mSubscription);
+  for (unsigned i = 0; i < CLIPMAP_LEVELS; ++i) {
+    scene->clipmapRegions[i].unsubscribe(mClipmapSubscriptions[i]);
+  }
+}
+
+void
+SectionMeshComponent::onUpdate(float delta)
+{
+  auto& cameraPos = scene()->camera->position();
+  // Out of the ring the chunk holds other voxels
+  for (auto it = sections.begin(); it != sections.end();) {
+    if (isInsideRing(it->second, cameraPos)) {
+      ++it;
+    } else {
+      deleteBuffers(it->second);
+      it = sections.erase(it);
+    }
+  }
+  for (auto& [key, mesh] : sections) {
+    if (!mesh.queued && mLodLevel(mesh, cameraPos) != mesh.level) {
+      mesh.queued = true;
+      pendingSections.push_back(key);
+    }
+  }
+  // Dropped with the ring, or already built
+  auto dropped = remove_if(
+    pendingSections.begin(), pendingSections.end(), [&](uint64_t key) {
+      auto it = sections.find(key);
+      return it == sections.end() || !it->second.queued;
+    });
+  pendingSections.erase(dropped, pendingSections.end());
+  if (pendingSections.empty()) {
+    return;
+  }
+  auto distance = [&](uint64_t key) {
+    auto& mesh     = sections.at(key);
+    auto  localPos = glm::vec3(mesh.lowerBound) +
+                    sectionSide(mesh.clipmapLevel) / 2.f - cameraPos;
+    return glm::dot(localPos, localPos);
+  };
+  auto count = min<size_t>(sectionsPerFrame, pendingSections.size());
+  partial_sort(pendingSections.begin(),
+               pendingSections.begin() + count,
+               pendingSections.end(),
+               [&](auto& lhs, auto& rhs) {
+                 return distance(lhs) < distance(rhs);
+               });
+  for (size_t i = 0; i < count; ++i) {
+    mBuild(sections.at(pendingSections[i]));
+  }
+  pendingSections.erase(pendingSections.begin(),
+                        pendingSections.begin() + count);
+}
+
+static void
+bindMesh(const SectionMesh& mesh)
+{
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+
+  // position attribute
+  glVertexAttribPointer(
+    0, 3, GL_FLOAT, GL_FALSE, sizeof(SectionVertex), (void*)0);
+  glEnableVertexAttribArray(0);
+
+  // normal attribute
+  glVertexAttribPointer(1,
+                        3,
+                        GL_FLOAT,
+                        GL_FALSE,
+                        sizeof(SectionVertex),
+                        (void*)offsetof(SectionVertex, normalX));
+  glEnableVertexAttribArray(1);
+
+  // texture attribute
+  glVertexAttribPointer(2,
+                        2,
+                        GL_FLOAT,
+                        GL_FALSE,
+                        sizeof(SectionVertex),
+                        (void*)offsetof(SectionVertex, texR));
+  glEnableVertexAttribArray(2);
+
+  // The VAO is shared, the VoxelModel tangent would be read past its buffer
+  glDisableVertexAttribArray(3);
+
+  // occlusion attribute
+  glVertexAttribPointer(4,
+                        1,
+                        GL_FLOAT,
+                        GL_FALSE,
+                        sizeof(SectionVertex),
+                        (void*)offsetof(SectionVertex, occlusion));
+  glEnableVertexAttribArray(4);
+}
+
+void
+SectionMeshComponent::draw(const SectionMesh& mesh) const
+{
+  bindMesh(mesh);
+  glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, nullptr);
+}
+
+void
+SectionMeshComponent::draw(const SectionMesh&  mesh,
+                           const SectionRange& range) const
+{
+  bindMesh(mesh);
+  glDrawElements(GL_TRIANGLES,
+                 range.count,
+                 GL_UNSIGNED_INT,
+                 (void*)(range.first * sizeof(unsigned)));
+}
+
+void
+SectionMeshComponent::mMarkDirty(const DirtyRegion& region,
+                                 unsigned           clipmapLevel)
+{
+  auto& cameraPos = scene()->camera->position();
+  int   side      = sectionSide(clipmapLevel);
+  // The coarsest cells it touches change, then the faces against them
+  int cellSide = clipmapLevel ? 1 << clipmapLevel : PYRAMID_CELL_SIDE;
+  auto lower   = [&](int value) {
+    return ((value & ~(cellSide - 1)) - 1) & ~(side - 1);
+  };
+  auto higher = [&](int value) {
+    return ((value + cellSide - 1) & ~(cellSide - 1)) + 1;
+  };
+  glm::ivec3 lowerBound(lower(region.lowerBound.x),
+                        lower(region.lowerBound.y),
+                        lower(region.lowerBound.z));
+  glm::ivec3 higherBound(higher(region.higherBound.x),
+                         higher(region.higherBound.y),
+                         higher(region.higherBound.z));
+  auto       ring = sectionRing(clipmapLevel, cameraPos);
+  glm::ivec3 pos;
+  for (pos.z = lowerBound.z; pos.z < higherBound.z; pos.z += side) {
+    for (pos.y = lowerBound.y; pos.y < higherBound.y; pos.y += side) {
+      for (pos.x = lowerBound.x; pos.x < higherBound.x; pos.x += side) {
+        if (!ring.contains(pos)) {
+          continue;
+        }
+        auto  key         = sectionKey(pos, clipmapLevel);
+        auto& mesh        = sections[key];
+        mesh.lowerBound   = pos;
+        mesh.clipmapLevel = clipmapLevel;
+        mesh.dirty        = true;
+        if (!mesh.queued) {
+          mesh.queued = true;
+          pendingSections.push_back(key);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief If a chunk voxel is empty across a face of a coarse cell
+ *
+ * Faces on the section border check this, as the section beyond may be
+ * meshed at full resolution. Without them the gap left by a coarse surface
+ * higher than the fine one next to it would show the sky through.
+ */
+static bool
+fineGapAcross(const Chunk&      chunk,
+              unsigned          level,
+              const glm::ivec3& cell,
+              unsigned          face)
+{
+  int        side   = 1 << level;
+  auto&      normal = faceNeighbours[face];
+  glm::ivec3 lowerBound, higherBound;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (normal[axis] == 0) {
+      lowerBound[axis]  = cell[axis] * side;
+      higherBound[axis] = lowerBound[axis] + side;
+    } else {
+      lowerBound[axis] =
+        normal[axis] > 0 ? (cell[axis] + 1) * side : cell[axis] * side - 1;
+      higherBound[axis] = lowerBound[axis] + 1;
+    }
+  }
+  glm::ivec3 pos;
+  for (pos.z = lowerBound.z; pos.z < higherBound.z; ++pos.z) {
+    for (pos.y = lowerBound.y; pos.y < higherBound.y; ++pos.y) {
+      for (pos.x = lowerBound.x; pos.x < higherBound.x; ++pos.x) {
+        if (chunk.at(pos).blockType == NO_BLOCK) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+unsigned
+SectionMeshComponent::mLodLevel(const SectionMesh& mesh,
+                                const glm::vec3&   cameraPos) const
+{
+  // Clipmaps are already coarse, they are meshed from their own cells
+  if (mesh.clipmapLevel) {
+    return 0;
+  }
+  glm::vec3 lowerBound(mesh.lowerBound);
+  auto      nearest =
+    glm::clamp(cameraPos, lowerBound, lowerBound + float(SECTION_SIDE));
+  float dist    = glm::length(nearest - cameraPos);
+  auto  levelAt = [&](float dist) {
+    if (dist < lodDistance) {
+      return 0u;
+    }
+    return min(PYRAMID_LEVELS, 1u + unsigned(log2(dist / lodDistance)));
+  };
+  // Keep the current level while inside the margin around its range
+  return clamp(
+    mesh.level, levelAt(dist - LOD_MARGIN), levelAt(dist + LOD_MARGIN));
+}
+
+void
+SectionMeshComponent::mBuild(SectionMesh& mesh)
+{
+  auto& corners = meshCorners();
+  struct Face
+  {
+    unsigned   blockType;
+    unsigned   face;
+    glm::ivec3 cell;
+  };
+  vector<Face> faces;
+  auto&        chunk     = scene()->chunk;
+  auto&        pyramid   = scene()->pyramid;
+  auto&        clipmap   = scene()->clipmap(mesh.clipmapLevel);
+  unsigned     level     = mLodLevel(mesh, scene()->camera->position());
+  int          cellSide  = 1 << (mesh.clipmapLevel ? mesh.clipmapLevel : level);
+  glm::ivec3   lowerCell = mesh.lowerBound / cellSide;
+  glm::ivec3   higherCell =
+    lowerCell + sectionSide(mesh.clipmapLevel) / cellSide;
+  DirtyRegion sectionCells{lowerCell, higherCell};
+  auto        blockAt = [&](const glm::ivec3& cell) {
+    if (mesh.clipmapLevel) {
+      return clipmap.at(cell).blockType;
+    }
+    return pyramid.at(level, cell);
+  };
+  glm::ivec3 cell;
+  for (cell.z = lowerCell.z; cell.z < higherCell.z; ++cell.z) {
+    for (cell.y = lowerCell.y; cell.y < higherCell.y; ++cell.y) {
+      for (cell.x = lowerCell.x; cell.x < higherCell.x; ++cell.x) {
+        auto blockType = blockAt(cell);
+        if (blockType == NO_BLOCK) {
+          continue;
+        }
+        for (unsigned face = 0; face < 6; ++face) {
+          auto neighbour = cell + faceNeighbours[face];
+          bool exposed   = blockAt(neighbour) == NO_BLOCK;
+          if (!exposed && level && !sectionCells.contains(neighbour)) {
+            exposed = fineGapAcross(chunk, level, cell, face);
+          }
+          if (exposed) {
+            faces.push_back({blockType, face, cell});
+          }
+        }
+      }
+    }
+  }
+  mesh.level  = level;
+  mesh.dirty  = false;
+  mesh.queued = false;
+
+  glm::ivec3 higherBound = mesh.lowerBound + sectionSide(mesh.clipmapLevel);
+  if (faces.empty()) {
+    deleteBuffers(mesh);
+    meshed.publish({mesh.lowerBound, higherBound});
+    return;
+  }
+  stable_sort(faces.begin(), faces.end(), [](auto& lhs, auto& rhs) {
+    return lhs.blockType < rhs.blockType;
+  });
+
+  vector<SectionVertex> vertices;
+  vector<unsigned>      indexes;
+  vertices.reserve(faces.size() * 4);
+  indexes.reserve(faces.size() * 6);
+  mesh.ranges.clear();
+  for (auto& face : faces) {
+    if (mesh.ranges.empty() ||
+        mesh.ranges.back().blockType != face.blockType) {
+      mesh.ranges.push_back({face.blockType, unsigned(indexes.size()), 0});
+    }
+    unsigned base   = vertices.size();
+    auto     center = (glm::vec3(face.cell) + .5f) * float(cellSide);
+    unsigned occlusion[4];
+    for (unsigned i = 0; i < 4; ++i) {
+      auto& corner   = corners[face.face][i];
+      auto  position = center + corner.vertex.position * float(cellSide);
+      // One texture repetition per voxel, as the finer levels look
+      auto texCoord = corner.vertex.texCoord * float(cellSide);
+      occlusion[i]  = vertexOcclusion(blockAt, face.cell, corner);
+      vertices.push_back({position.x,
+                          position.y,
+                          position.z,
+                          corner.vertex.normal.x,
+                          corner.vertex.normal.y,
+                          corner.vertex.normal.z,
+                          texCoord.x,
+                          texCoord.y,
+                          occlusionLight[occlusion[i]]});
+    }
+    bool flip = occlusion[0] + occlusion[3] < occlusion[1] + occlusion[2];
+    for (auto index : flip ? flippedFaceIndexes : faceIndexes) {
+      indexes.push_back(base + index);
+    }
+    mesh.ranges.back().count += 6;
+  }
+
+  if (!mesh.vbo) {
+    glGenBuffers(1, &mesh.vbo);
+    glGenBuffers(1, &mesh.ebo);
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo);
+  glBufferData(GL_ARRAY_BUFFER,
+               vertices.size() * sizeof(SectionVertex),
+               vertices.data(),
+               GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               indexes.size() * sizeof(unsigned),
+               indexes.data(),
+               GL_STATIC_DRAW);
+  mesh.indexCount = indexes.size();
+  meshed.publish({mesh.lowerBound, higherBound});
+}
@@ -0,0 +1,171 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "ChunkPyramid.hpp"
+#include "DirtyRegion.hpp"
+#include "SceneComponent.hpp"
+
+/// Side of the cubes the chunk is meshed by, a divisor of CHUNK_LOAD_DELTA
+constexpr int SECTION_SIDE = 32;
+/// Distance between opposite section corners
+constexpr float SECTION_DIAGONAL = SECTION_SIDE * 1.7320508f;
+
+/**
+ * @brief The key of the section containing a voxel
+ *
+ * @param clipmapLevel the sections of level L are SECTION_SIDE << L voxels
+ */
+inline uint64_t
+sectionKey(const glm::ivec3& pos, unsigned clipmapLevel = 0)
+{
+  int  side = SECTION_SIDE << clipmapLevel;
+  auto axis = [side](int value) {
+    auto section = (value & ~(side - 1)) / side;
+    return uint64_t(uint32_t(section) & 0x7ffff);
+  };
+  return uint64_t(clipmapLevel) << 57 | axis(pos.x) << 38 |
+         axis(pos.y) << 19 | axis(pos.z);
+}
+
+/**
+ * @brief The box covered by the sections of a clipmap level
+ *
+ * These are the sections fully inside the ring the level holds around the
+ * camera, the others may have cells of another place.
+ */
+inline DirtyRegion
+sectionRing(unsigned clipmapLevel, const glm::vec3& cameraPos)
+{
+  int         scale = 1 << clipmapLevel;
+  int         side  = SECTION_SIDE << clipmapLevel;
+  DirtyRegion ring;
+  for (int i = 0; i < 3; ++i) {
+    // Floored, truncating would shift the ring by a cell below zero
+    int center          = int(std::floor(cameraPos[i] / scale)) * scale;
+    int lower           = center - CHUNK_HALF_SIDE * scale;
+    int higher          = center + CHUNK_HALF_SIDE * scale;
+    ring.lowerBound[i]  = (lower + side - 1) & ~(side - 1);
+    ring.higherBound[i] = higher & ~(side - 1);
+  }
+  return ring;
+}
+
+/// Light left at a vertex surrounded by three voxels
+constexpr float AO_MIN_LIGHT = .4f;
+
+/**
+ * @brief The faces of one block type inside a SectionMesh
+ *
+ * The range is in indexes, [first, first + count).
+ */
+struct SectionRange
+{
+  unsigned blockType;
+  unsigned first;
+  unsigned count;
+};
+
+/**
+ * @brief The exposed voxel faces of a section, in world coordinates
+ *
+ * The vertices have the layout of VoxelModel, minus the tangent: position,
+ * normal and texture coordinates at attributes 0, 1 and 2. Attribute 4 is the
+ * ambient occlusion of the vertex, from 1 in the open to AO_MIN_LIGHT in a
+ * corner. Quads are split along the diagonal that keeps the occlusion
+ * gradient symmetric, so it interpolates without creases.
+ *
+ * Far sections are meshed from a ChunkPyramid level, with faces as big as its
+ * cells and textures repeated once per voxel. Clipmap sections are meshed the
+ * same way from their clipmap, SECTION_SIDE cells of side.
+ */
+struct SectionMesh
+{
+  glm::ivec3 lowerBound;
+  unsigned   vbo        = 0;
+  unsigned   ebo        = 0;
+  unsigned   indexCount = 0;
+  /// The pyramid level it was meshed from, 0 for the chunk
+  unsigned level = 0;
+  /// The clipmap it belongs to, 0 for the chunk ring
+  unsigned clipmapLevel = 0;
+  /// Its voxels changed since it was meshed
+  bool dirty = false;
+  /// In pendingSections, for being dirty or needing another level
+  bool                      queued = false;
+  std::vector<SectionRange> ranges;
+};
+
+/**
+ * @brief Keeps a mesh per section of the chunk ring, for the passes drawing
+ * many voxels at once
+ *
+ * Dirty regions queue the sections they touch, their neighbours too as the
+ * faces and occlusion between them may change. Up to sectionsPerFrame are
+ * rebuilt on each update, the nearest to the camera first, and then published
+ * on meshed.
+ *
+ * Sections past lodDistance are meshed from pyramid level 1, and one level
+ * coarser each time the distance doubles. A section only changes level once
+ * it is LOD_MARGIN past the threshold, so it does not flip back and forth.
+ *
+ * Each clipmap with content gets its own sections, keyed by level too. They
+ * are left to the caller to clip against the finer levels, see sectionRing().
+ */
+struct SectionMeshComponent : public SceneComponent
+{
+  unsigned                                  sectionsPerFrame = 8;
+  float                                     lodDistance      = 48.f;
+  std::unordered_map<uint64_t, SectionMesh> sections;
+  std::vector<uint64_t>                     pendingSections;
+  /// The sections rebuilt, after their buffers were updated
+  DirtyRegionPublisher meshed;
+
+  ~SectionMeshComponent();
+
+  virtual void onUpdate(float delta) final;
+
+  /**
+   * @brief Draw the whole mesh, all block types
+   *
+   */
+  void draw(const SectionMesh& mesh) const;
+
+  /**
+   * @brief Draw the faces of one block type
+   *
+   */
+  void draw(const SectionMesh& mesh, const SectionRange& range) const;
+
+  /**
+   * @brief Call back each chunk ring mesh with geometry intersecting the region
+   *
+   * Clipmap sections are skipped, they are only drawn past the chunk ring.
+   */
+  template<class CALLBACK>
+  void forEachSection(const DirtyRegion& region, CALLBACK callback) const
+  {
+    for (auto& [key, mesh] : sections) {
+      if (mesh.indexCount && mesh.clipmapLevel == 0 &&
+          region.intersects(
+            {mesh.lowerBound, mesh.lowerBound + SECTION_SIDE})) {
+        callback(mesh);
+      }
+    }
+  }
+
+protected:
+  virtual void onAttach(SceneDetail* scene) final;
+  virtual void onDetach(SceneDetail* scene) final;
+
+private:
+  void     mMarkDirty(const DirtyRegion& region, unsigned clipmapLevel);
+  void     mBuild(SectionMesh& mesh);
+  unsigned mLodLevel(const SectionMesh& mesh, const glm::vec3& cameraPos) const;
+
+private:
+  unsigned mSubscription                         = 0;
+  unsigned mClipmapSubscriptions[CLIPMAP_LEVELS] = {};
+};
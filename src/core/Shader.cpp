@@ -14,6 +14,15 @@ Shader::~Shader()
 
 Shader
 Shader::fromFilePath(ShaderType type, const char* path)
+{
+  MappedFile shaderFile(path);
+  return fromSource(type, shaderFile.view());
+}
+
+Shader
+Shader::fromSource(ShaderType       type,
+                   std::string_view source,
+                   std::string_view preamble)
 {
   unsigned shaderId;
   switch (type) {
@@ -26,9 +35,26 @@ Shader::fromFilePath(ShaderType type, const char* path)
     default:
       throw std::logic_error("Invalid shader type");
   }
-  auto shaderSource     = readFile(path);
-  auto shaderSourceChar = shaderSource.c_str();
-  glShaderSource(shaderId, 1, &shaderSourceChar, NULL);
+  // The #version must stay first
+  auto version = source.substr(0, 0);
+  if (source.compare(0, 8, "#version") == 0) {
+    version = source.substr(0, source.find('\n') + 1);
+    source.remove_prefix(version.size());
+  }
+  // Back to the file numbering, so errors point at the right source lines
+  std::string_view line;
+  if (!preamble.empty()) {
+    line = version.empty() ? "#line 1\n" : "#line 2\n";
+  }
+  const char* shaderSourceChars[] = {version.data(),
+                                     preamble.empty() ? "" : preamble.data(),
+                                     line.empty() ? "" : line.data(),
+                                     source.data()};
+  int shaderSourceLengths[] = {int(version.size()),
+                               int(preamble.size()),
+                               int(line.size()),
+                               int(source.size())};
+  glShaderSource(shaderId, 4, shaderSourceChars, shaderSourceLengths);
   glCompileShader(shaderId);
 
   int success;
@@ -54,6 +80,45 @@ ShaderProgram::~ShaderProgram()
 ShaderProgram::ShaderProgram()
 {
   mShaderProgramId = glCreateProgram();
+  if (GLEW_ARB_get_program_binary) {
+    glProgramParameteri(
+      mShaderProgramId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+}
+
+ShaderProgram
+ShaderProgram::fromBinary(unsigned format, std::string_view binary)
+{
+  if (!GLEW_ARB_get_program_binary) {
+    throw std::runtime_error("Program binaries not supported");
+  }
+  ShaderProgram program;
+  glProgramBinary(
+    program.mShaderProgramId, format, binary.data(), binary.size());
+  int success;
+  glGetProgramiv(program.mShaderProgramId, GL_LINK_STATUS, &success);
+  if (!success) {
+    throw std::runtime_error("Program binary rejected");
+  }
+  return program;
+}
+
+std::string
+ShaderProgram::binary(unsigned* format) const
+{
+  int length = 0;
+  if (GLEW_ARB_get_program_binary) {
+    glGetProgramiv(mShaderProgramId, GL_PROGRAM_BINARY_LENGTH, &length);
+  }
+  std::string result(length, '\0');
+  if (length > 0) {
+    GLenum binaryFormat;
+    glGetProgramBinary(
+      mShaderProgramId, length, &length, &binaryFormat, result.data());
+    result.resize(length);
+    *format = binaryFormat;
+  }
+  return result;
 }
 
 int
@@ -1,4 +1,6 @@
 #pragma once
+#include <string>
+#include <string_view>
 
 enum class ShaderType : char
 {
@@ -38,6 +40,18 @@ public:
   }
 
   static Shader fromFilePath(ShaderType type, const char* path);
+  /**
+   * @brief Compile a shader from its source
+   *
+   * @param type the shader type
+   * @param source the GLSL source
+   * @param preamble code inserted right after the #version line, usually
+   * #defines for a permutation. A #line follows it, so errors keep the line
+   * numbers of source.
+   */
+  static Shader fromSource(ShaderType       type,
+                           std::string_view source,
+                           std::string_view preamble = {});
 
   unsigned shaderId() const { return mShaderId; }
 
@@ -84,6 +98,21 @@ public:
     return *this;
   }
 
+  /**
+   * @brief Create from a binary previously obtained with binary()
+   *
+   * It throws if the driver rejects it, which happens when it changes.
+   */
+  static ShaderProgram fromBinary(unsigned format, std::string_view binary);
+
+  /**
+   * @brief Get the linked program binary, if the driver supports it
+   *
+   * @param format receives the binary format
+   * @return std::string the binary, empty when not available
+   */
+  std::string binary(unsigned* format) const;
+
   unsigned shaderProgramId() const { return mShaderProgramId; }
   int getUniformLocation(const char *locName) const;
 
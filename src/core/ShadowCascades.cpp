@@ -0,0 +1,183 @@
+#include "ShadowCascades.hpp"
+#include <stdexcept>
+#include <string>
+#include <GL/glew.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/transform.hpp>
+#include "SectionMeshComponent.hpp"
+#include "Shader.hpp"
+
+using namespace std;
+
+/// Distance from the camera each cascade shadows, the next one takes over
+static const float SHADOW_CASCADE_RANGES[SHADOW_CASCADES] = {16, 48, 144};
+
+/// Casters this far beyond a cascade box, towards the light, still shadow it
+constexpr float SHADOW_CASTER_REACH = 64;
+
+/**
+ * @brief Half the side of the box a cascade renders
+ *
+ * Centers snap to half the range, so the camera is at most .43 ranges away
+ * from it, and everything in range stays inside the box.
+ */
+inline float
+cascadeHalfSide(unsigned cascade)
+{
+  return SHADOW_CASCADE_RANGES[cascade] * 1.5f;
+}
+
+/**
+ * @brief The region whose voxels may appear in a cascade
+ *
+ */
+inline DirtyRegion
+cascadeRegion(const glm::vec3& center, unsigned cascade)
+{
+  float reach = cascadeHalfSide(cascade) + SHADOW_CASTER_REACH;
+  return {glm::ivec3(glm::floor(center - reach)),
+          glm::ivec3(glm::ceil(center + reach))};
+}
+
+ShadowCascades::ShadowCascades()
+{
+  glGenTextures(1, &mDepthTexture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, mDepthTexture);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY,
+               0,
+               GL_DEPTH_COMPONENT24,
+               SHADOW_MAP_SIZE,
+               SHADOW_MAP_SIZE,
+               SHADOW_CASCADES,
+               0,
+               GL_DEPTH_COMPONENT,
+               GL_FLOAT,
+               nullptr);
+  // Hardware 2x2 PCF, and lit outside the map
+  float border[] = {1, 1, 1, 1};
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY,
+                  GL_TEXTURE_COMPARE_MODE,
+                  GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+  glGenFramebuffers(1, &mFrameBufferId);
+  glBindFramebuffer(GL_FRAMEBUFFER, mFrameBufferId);
+  glFramebufferTextureLayer(
+    GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mDepthTexture, 0, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  auto status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    throw runtime_error("Incomplete shadow framebuffer " + to_string(status));
+  }
+}
+
+ShadowCascades::~ShadowCascades()
+{
+  glDeleteFramebuffers(1, &mFrameBufferId);
+  glDeleteTextures(1, &mDepthTexture);
+}
+
+void
+ShadowCascades::update(const SectionMeshComponent& meshes,
+                       const glm::vec3&            cameraPos,
+                       const glm::vec3&            lightDirection,
+                       const ShaderProgram&        shaderProgram)
+{
+  auto direction = glm::normalize(lightDirection);
+  if (direction != mLightDirection) {
+    mLightDirection = direction;
+    for (auto& cascade : mCascades) {
+      cascade.stale = true;
+    }
+  }
+  auto up = abs(direction.z) > .99f ? glm::vec3(0, 1, 0) : glm::vec3(0, 0, 1);
+
+  bool rendering = false;
+  for (unsigned i = 0; i < SHADOW_CASCADES; ++i) {
+    auto& cascade = mCascades[i];
+    float step    = SHADOW_CASCADE_RANGES[i] / 2;
+    auto  center  = glm::round(cameraPos / step) * step;
+    if (center != cascade.center) {
+      cascade.center = center;
+      cascade.stale  = true;
+    }
+    if (!cascade.stale) {
+      continue;
+    }
+    if (!rendering) {
+      glBindFramebuffer(GL_FRAMEBUFFER, mFrameBufferId);
+      glViewport(0, 0, SHADOW_MAP_SIZE, SHADOW_MAP_SIZE);
+      glUseProgram(shaderProgram.shaderProgramId());
+      // Back faces and an offset, so lit faces do not shadow themselves
+      glCullFace(GL_FRONT);
+      glEnable(GL_POLYGON_OFFSET_FILL);
+      glPolygonOffset(2, 4);
+      rendering = true;
+    }
+    float halfSide   = cascadeHalfSide(i);
+    float distance   = halfSide + SHADOW_CASTER_REACH;
+    auto  view       = glm::lookAt(center - direction * distance, center, up);
+    auto  projection = glm::ortho(
+      -halfSide, halfSide, -halfSide, halfSide, 0.f, distance + halfSide);
+    cascade.viewProjection = projection * view;
+    glFramebufferTextureLayer(
+      GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mDepthTexture, 0, i);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glUniformMatrix4fv(shaderProgram.getUniformLocation("lightViewProjection"),
+                       1,
+                       GL_FALSE,
+                       glm::value_ptr(cascade.viewProjection));
+    meshes.forEachSection(cascadeRegion(center, i),
+                          [&](const SectionMesh& mesh) { meshes.draw(mesh); });
+    cascade.stale = false;
+    ++mRenders;
+  }
+  if (rendering) {
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glCullFace(GL_BACK);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+}
+
+void
+ShadowCascades::invalidate(const DirtyRegion& region)
+{
+  for (unsigned i = 0; i < SHADOW_CASCADES; ++i) {
+    if (region.intersects(cascadeRegion(mCascades[i].center, i))) {
+      mCascades[i].stale = true;
+    }
+  }
+}
+
+void
+ShadowCascades::bind(const ShaderProgram& shaderProgram,
+                     const glm::mat4&     view) const
+{
+  // From clip space to texture coordinates and depth
+  static const glm::mat4 bias =
+    glm::translate(glm::vec3(.5f)) * glm::scale(glm::vec3(.5f));
+  auto      inverseView = glm::inverse(view);
+  glm::mat4 matrices[SHADOW_CASCADES];
+  for (unsigned i = 0; i < SHADOW_CASCADES; ++i) {
+    matrices[i] = bias * mCascades[i].viewProjection * inverseView;
+  }
+  glUseProgram(shaderProgram.shaderProgramId());
+  glUniformMatrix4fv(shaderProgram.getUniformLocation("shadowMatrices"),
+                     SHADOW_CASCADES,
+                     GL_FALSE,
+                     glm::value_ptr(matrices[0]));
+  glUniform1fv(shaderProgram.getUniformLocation("shadowRanges"),
+               SHADOW_CASCADES,
+               SHADOW_CASCADE_RANGES);
+  glUniform1i(shaderProgram.getUniformLocation("shadowMap"), SHADOW_MAP_UNIT);
+  glActiveTexture(GL_TEXTURE0 + SHADOW_MAP_UNIT);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, mDepthTexture);
+  glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "DirtyRegion.hpp"
+
+class ShaderProgram;
+struct SectionMeshComponent;
+
+/// Cascades in the shadow map array, the SHADOWS define of the shaders
+constexpr unsigned SHADOW_CASCADES = 3;
+constexpr int      SHADOW_MAP_SIZE = 1024;
+/// Texture unit of the shadow map, after the ones the lighting pass uses
+constexpr unsigned SHADOW_MAP_UNIT = 6;
+
+/**
+ * @brief Shadow maps of the directional light, one per distance range
+ *
+ * A cascade covers a box around a point snapped to a grid, larger than its
+ * range, so the camera can move a while before it is re-centered. It is only
+ * re-rendered when it moves, the light turns or a mesh inside it is rebuilt,
+ * otherwise the last render is reused.
+ */
+class ShadowCascades
+{
+public:
+  ShadowCascades();
+  ~ShadowCascades();
+  ShadowCascades(const ShadowCascades&) = delete;
+  ShadowCascades(ShadowCascades&&)      = delete;
+  ShadowCascades& operator=(const ShadowCascades&) = delete;
+  ShadowCascades& operator=(ShadowCascades&&) = delete;
+
+  /**
+   * @brief Follow the camera and light, re-rendering the stale cascades
+   *
+   * It changes the framebuffer binding and viewport.
+   *
+   * @param meshes the shadow casters
+   * @param cameraPos the camera position
+   * @param lightDirection the direction the light travels, in world space
+   * @param shaderProgram a depth only program, taking a lightViewProjection
+   */
+  void update(const SectionMeshComponent& meshes,
+              const glm::vec3&            cameraPos,
+              const glm::vec3&            lightDirection,
+              const ShaderProgram&        shaderProgram);
+
+  /**
+   * @brief Mark the cascades covering the region to be re-rendered
+   *
+   */
+  void invalidate(const DirtyRegion& region);
+
+  /**
+   * @brief Set the shadow uniforms of a program using SHADOWS
+   *
+   * Shaders look the map up from view space positions, so it must be called
+   * again each time the view changes. The map is bound to SHADOW_MAP_UNIT.
+   *
+   * @param shaderProgram the program, it is made current
+   * @param view the camera view matrix
+   */
+  void bind(const ShaderProgram& shaderProgram, const glm::mat4& view) const;
+
+  /// Cascade renders since created, it stops growing when nothing changes
+  unsigned renders() const { return mRenders; }
+
+private:
+  struct Cascade
+  {
+    glm::vec3 center{0};
+    glm::mat4 viewProjection{1.f};
+    bool      stale = true;
+  };
+
+  Cascade   mCascades[SHADOW_CASCADES];
+  glm::vec3 mLightDirection{0};
+  unsigned  mFrameBufferId;
+  unsigned  mDepthTexture;
+  unsigned  mRenders = 0;
+};
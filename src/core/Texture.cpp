@@ -1,45 +1,126 @@
 #include "Texture.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <stdexcept>
 #include <GL/glew.h>
+#include "util/assetArchive.hpp"
+#include "util/fileReader.hpp"
 #include "util/stb_image.h"
 
 using namespace std;
 
-Texture::Texture(const char* file)
+/// Largest side a cooked texture may claim, so level sizes can not overflow
+constexpr uint32_t MAX_COOKED_TEXTURE_SIDE = 1 << 15;
+
+TextureData
+TextureData::fromFile(const char* file,
+                      bool        allowCompressed,
+                      string*     cacheError)
 {
-  int            width, height, nrChannels;
-  unsigned char* data = stbi_load(file, &width, &height, &nrChannels, 0);
-  if (!data) {
-    throw std::runtime_error("Error loading image ");
+  auto cookedPath = cookedTexturePath(file);
+  // Archives are packed after cooking, so their cooked textures are fresh
+  bool fresh = findArchivedFile(cookedPath).has_value();
+  if (!fresh) {
+    error_code ec;
+    auto       cookedTime = filesystem::last_write_time(cookedPath, ec);
+    if (!ec) {
+      auto sourceTime = filesystem::last_write_time(file, ec);
+      fresh           = ec || cookedTime >= sourceTime;
+    }
   }
-  glGenTextures(1, &mTextureId);
-  glBindTexture(GL_TEXTURE_2D, mTextureId);
-  if (nrChannels == 3) {
-    glTexImage2D(GL_TEXTURE_2D,
-                 0,
-                 GL_RGB,
-                 width,
-                 height,
-                 0,
-                 GL_RGB,
-                 GL_UNSIGNED_BYTE,
-                 data);
-  } else if (nrChannels == 4) {
-    glTexImage2D(GL_TEXTURE_2D,
-                 0,
-                 GL_RGBA,
-                 width,
-                 height,
-                 0,
-                 GL_RGBA,
-                 GL_UNSIGNED_BYTE,
-                 data);
+  if (fresh) {
+    try {
+      auto data = fromCookedFile(cookedPath.c_str());
+      if (allowCompressed || !isCompressed(data.format)) {
+        return data;
+      }
+    } catch (const exception& e) {
+      // A truncated, corrupt or old version cache, the source is still good
+      if (cacheError) {
+        *cacheError = e.what();
+      }
+    }
   }
-  glGenerateMipmap(GL_TEXTURE_2D);
-  glTexParameteri(
-    GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  return decode(file);
+}
+
+TextureData
+TextureData::decode(const char* file)
+{
+  MappedFile imageFile(file);
+  int        width, height, channels;
+  if (!stbi_info_from_memory(
+        imageFile.data(), imageFile.size(), &width, &height, &channels)) {
+    throw std::runtime_error("Error loading image "s + file);
+  }
+  channels            = channels == 3 ? 3 : 4;
+  unsigned char* data = stbi_load_from_memory(
+    imageFile.data(), imageFile.size(), &width, &height, nullptr, channels);
+  if (!data) {
+    throw std::runtime_error("Error loading image "s + file);
+  }
+  TextureData result;
+  result.width  = width;
+  result.height = height;
+  result.format = channels == 3 ? PixelFormat::RGB8 : PixelFormat::RGBA8;
+  result.pixels.assign(data, data + width * height * channels);
+  result.levels.push_back({width, height, 0, result.pixels.size()});
   stbi_image_free(data);
+  return result;
+}
+
+TextureData
+TextureData::fromCookedFile(const char* file)
+{
+  TextureData result;
+  result.cookedFile = MappedFile(file);
+  CookedTextureHeader header;
+  auto                size = result.cookedFile.size();
+  if (size < sizeof(header)) {
+    throw std::runtime_error("Invalid cooked texture "s + file);
+  }
+  memcpy(&header, result.cookedFile.data(), sizeof(header));
+  if (header.magic != COOKED_TEXTURE_MAGIC ||
+      header.version != COOKED_TEXTURE_VERSION ||
+      header.format > PixelFormat::BC3 || header.width == 0 ||
+      header.height == 0 || header.width > MAX_COOKED_TEXTURE_SIDE ||
+      header.height > MAX_COOKED_TEXTURE_SIDE ||
+      size < sizeof(header) +
+               uint64_t(header.levels) * sizeof(CookedTextureLevel)) {
+    throw std::runtime_error("Invalid cooked texture "s + file);
+  }
+  result.width  = header.width;
+  result.height = header.height;
+  result.format = header.format;
+  for (unsigned i = 0; i < header.levels; ++i) {
+    CookedTextureLevel level;
+    memcpy(&level,
+           result.cookedFile.data() + sizeof(header) + i * sizeof(level),
+           sizeof(level));
+    // Each level halves the last one, as the cooker writes them
+    if (level.width != max(header.width >> i, 1u) ||
+        level.height != max(header.height >> i, 1u) ||
+        level.size !=
+          pixelFormatSize(header.format, level.width, level.height)) {
+      throw std::runtime_error("Invalid cooked texture "s + file);
+    }
+    if (uint64_t(level.offset) + level.size > size) {
+      throw std::runtime_error("Truncated cooked texture "s + file);
+    }
+    result.levels.push_back({int(level.width),
+                             int(level.height),
+                             level.offset,
+                             level.size});
+  }
+  return result;
+}
+
+Texture::Texture(const char* file)
+  : Texture()
+{
+  auto data = TextureData::fromFile(file);
+  updateTexture(data, data.bytes());
 }
 
 Texture::Texture()
@@ -93,4 +174,79 @@ Texture::updateTexture(unsigned char* pixels,
   glTexParameteri(
     GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // Drivers store RGB padded to 4 bytes, the mip chain adds a third
+  mByteSize = size_t(width) * height * 4 * 4 / 3;
+}
+
+void
+Texture::updateTexture(const TextureData& data, const unsigned char* base)
+{
+  glBindTexture(GL_TEXTURE_2D, mTextureId);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  for (size_t i = 0; i < data.levels.size(); ++i) {
+    auto& level  = data.levels[i];
+    auto  pixels = base + level.offset;
+    switch (data.format) {
+      case PixelFormat::RGB8:
+        glTexImage2D(GL_TEXTURE_2D,
+                     i,
+                     GL_RGB,
+                     level.width,
+                     level.height,
+                     0,
+                     GL_RGB,
+                     GL_UNSIGNED_BYTE,
+                     pixels);
+        break;
+      case PixelFormat::RGBA8:
+        glTexImage2D(GL_TEXTURE_2D,
+                     i,
+                     GL_RGBA,
+                     level.width,
+                     level.height,
+                     0,
+                     GL_RGBA,
+                     GL_UNSIGNED_BYTE,
+                     pixels);
+        break;
+      case PixelFormat::BC1:
+        glCompressedTexImage2D(GL_TEXTURE_2D,
+                               i,
+                               GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+                               level.width,
+                               level.height,
+                               0,
+                               level.size,
+                               pixels);
+        break;
+      case PixelFormat::BC3:
+        glCompressedTexImage2D(GL_TEXTURE_2D,
+                               i,
+                               GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+                               level.width,
+                               level.height,
+                               0,
+                               level.size,
+                               pixels);
+        break;
+    }
+  }
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  mByteSize = 0;
+  for (auto& level : data.levels) {
+    mByteSize += isCompressed(data.format)
+                   ? level.size
+                   : size_t(level.width) * level.height * 4;
+  }
+  if (data.levels.size() > 1) {
+    glTexParameteri(
+      GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, data.levels.size() - 1);
+  } else {
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 1000);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    mByteSize = mByteSize * 4 / 3;
+  }
+  glTexParameteri(
+    GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 }
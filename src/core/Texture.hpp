@@ -1,4 +1,71 @@
 #pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "util/fileReader.hpp"
+#include "util/textureCooking.hpp"
+
+/**
+ * @brief A single mip level inside TextureData::bytes()
+ *
+ */
+struct TextureLevel
+{
+  int         width;
+  int         height;
+  std::size_t offset;
+  std::size_t size;
+};
+
+/**
+ * @brief A decoded image, ready to be uploaded
+ *
+ * It does not touch OpenGL, so it can be created on any thread. If there is a
+ * single level the mipmaps are generated on upload.
+ */
+struct TextureData
+{
+  int                        width    = 0;
+  int                        height   = 0;
+  PixelFormat                format   = PixelFormat::RGBA8;
+  std::vector<TextureLevel>  levels;
+  std::vector<unsigned char> pixels;
+  MappedFile                 cookedFile;
+
+  const unsigned char* bytes() const
+  {
+    return cookedFile.size() ? cookedFile.data() : pixels.data();
+  }
+  std::size_t byteSize() const
+  {
+    return cookedFile.size() ? cookedFile.size() : pixels.size();
+  }
+
+  /**
+   * @brief Load from the cooked cache if it is up to date and valid, or
+   * decode it
+   *
+   * @param file the source image path
+   * @param allowCompressed if false, block compressed caches are ignored
+   * @param cacheError if not null, set to why the cache was unreadable when
+   * the source is decoded because of it
+   */
+  static TextureData fromFile(const char*  file,
+                              bool         allowCompressed = true,
+                              std::string* cacheError      = nullptr);
+
+  /**
+   * @brief Decode an image (jpg, png, etc), ignoring any cache
+   *
+   */
+  static TextureData decode(const char* file);
+
+  /**
+   * @brief Map a file created by cookTexture()
+   *
+   */
+  static TextureData fromCookedFile(const char* file);
+};
 
 /**
  * @brief Represents a texture
@@ -17,8 +84,30 @@ public:
 
   void     activate(unsigned textureUnit);
   unsigned textureId() const { return mTextureId; }
+
+  /**
+   * @brief Estimated GPU memory, including mipmaps
+   *
+   */
+  std::size_t byteSize() const { return mByteSize; }
+
+  /**
+   * @brief Replace the content and regenerate the mipmaps
+   *
+   * If a GL_PIXEL_UNPACK_BUFFER is bound, pixels is an offset into it.
+   */
   void updateTexture(unsigned char* pixels, int width, int height, int channels = 4);
 
+  /**
+   * @brief Replace the content with all levels from data
+   *
+   * @param data the texture levels
+   * @param base where data.bytes() is. If a GL_PIXEL_UNPACK_BUFFER is bound,
+   * it is an offset into it.
+   */
+  void updateTexture(const TextureData& data, const unsigned char* base);
+
 private:
-  unsigned mTextureId;
+  unsigned    mTextureId;
+  std::size_t mByteSize = 0;
 };
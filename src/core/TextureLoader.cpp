@@ -0,0 +1,167 @@
+#include "TextureLoader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <GL/glew.h>
+
+using namespace std;
+
+TextureLoader::TextureLoader(unsigned workers)
+  : mCompressionSupported(GLEW_EXT_texture_compression_s3tc)
+{
+  if (workers == 0) {
+    workers = clamp(thread::hardware_concurrency(), 2u, 5u) - 1;
+  }
+  for (unsigned i = 0; i < workers; ++i) {
+    mWorkers.emplace_back([this] { mWork(); });
+  }
+}
+
+TextureLoader::~TextureLoader()
+{
+  {
+    lock_guard<mutex> lock(mMutex);
+    mStopping = true;
+  }
+  mJobAvailable.notify_all();
+  for (auto& worker : mWorkers) {
+    worker.join();
+  }
+  if (mPixelBuffers[0]) {
+    glDeleteBuffers(2, mPixelBuffers);
+  }
+}
+
+void
+TextureLoader::load(std::string              file,
+                    std::shared_ptr<Texture> target,
+                    bool                     reload)
+{
+  {
+    lock_guard<mutex> lock(mMutex);
+    mJobs.push_back({move(file), move(target), reload, Clock::now()});
+  }
+  mJobAvailable.notify_one();
+}
+
+unsigned
+TextureLoader::processUploads(std::size_t maxBytes)
+{
+  size_t   bytes    = 0;
+  unsigned uploaded = 0;
+  while (bytes < maxBytes) {
+    Result result;
+    {
+      lock_guard<mutex> lock(mMutex);
+      if (mResults.empty()) {
+        break;
+      }
+      result = move(mResults.front());
+      mResults.pop_front();
+    }
+    bytes += result.data.byteSize();
+    mUpload(result);
+    ++uploaded;
+  }
+  return uploaded;
+}
+
+void
+TextureLoader::finish()
+{
+  for (;;) {
+    Result result;
+    {
+      unique_lock<mutex> lock(mMutex);
+      mResultAvailable.wait(lock, [this] {
+        return !mResults.empty() || (mJobs.empty() && mDecoding == 0);
+      });
+      if (mResults.empty()) {
+        return;
+      }
+      result = move(mResults.front());
+      mResults.pop_front();
+    }
+    mUpload(result);
+  }
+}
+
+unsigned
+TextureLoader::pending() const
+{
+  lock_guard<mutex> lock(mMutex);
+  return mJobs.size() + mDecoding + mResults.size();
+}
+
+void
+TextureLoader::mWork()
+{
+  for (;;) {
+    Job job;
+    {
+      unique_lock<mutex> lock(mMutex);
+      mJobAvailable.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+      if (mStopping) {
+        return;
+      }
+      job = move(mJobs.front());
+      mJobs.pop_front();
+      ++mDecoding;
+    }
+    Result result{
+      job.file, {}, move(job.target), job.reload, job.requested};
+    try {
+      result.data = TextureData::fromFile(
+        job.file.c_str(), mCompressionSupported, &result.cacheError);
+    } catch (const exception& e) {
+      // Left empty, reported on upload
+      result.error = e.what();
+    }
+    {
+      lock_guard<mutex> lock(mMutex);
+      --mDecoding;
+      mResults.push_back(move(result));
+    }
+    mResultAvailable.notify_all();
+  }
+}
+
+void
+TextureLoader::mUpload(Result& result)
+{
+  auto& data = result.data;
+  if (data.levels.empty()) {
+    // Probably caught while being saved, the next change reloads it again
+    if (!result.reload) {
+      mLastError = result.error;
+    }
+    return;
+  }
+  if (!result.cacheError.empty()) {
+    mLastCacheError = result.cacheError;
+  }
+  if (!mPixelBuffers[0]) {
+    glGenBuffers(2, mPixelBuffers);
+  }
+  // Alternate buffers so we don't wait on the previous transfer
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mPixelBuffers[mNextPixelBuffer]);
+  mNextPixelBuffer = (mNextPixelBuffer + 1) % 2;
+  glBufferData(
+    GL_PIXEL_UNPACK_BUFFER, data.byteSize(), nullptr, GL_STREAM_DRAW);
+  if (void* buffer = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+                                      0,
+                                      data.byteSize(),
+                                      GL_MAP_WRITE_BIT |
+                                        GL_MAP_INVALIDATE_BUFFER_BIT)) {
+    memcpy(buffer, data.bytes(), data.byteSize());
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    result.target->updateTexture(data, nullptr);
+  } else {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    result.target->updateTexture(data, data.bytes());
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  if (result.reload) {
+    mLastReloadTime =
+      chrono::duration<float, milli>(Clock::now() - result.requested).count();
+  }
+}
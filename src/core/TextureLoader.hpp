@@ -0,0 +1,125 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Texture.hpp"
+
+/**
+ * @brief Decodes textures on worker threads and uploads them in small batches
+ *
+ * The target textures keep whatever content they had (usually a placeholder)
+ * until processUploads() replaces it on the render thread.
+ */
+class TextureLoader
+{
+public:
+  /**
+   * @brief Construct a new Texture Loader
+   *
+   * @param workers number of decoding threads. 0 means pick from hardware.
+   */
+  TextureLoader(unsigned workers = 0);
+  ~TextureLoader();
+  TextureLoader(const TextureLoader&) = delete;
+  TextureLoader(TextureLoader&&)      = delete;
+  TextureLoader& operator=(const TextureLoader&) = delete;
+  TextureLoader& operator=(TextureLoader&&) = delete;
+
+  /**
+   * @brief Schedule a file to be decoded into the given texture
+   *
+   * A file that fails to decode leaves the texture as it was. Unless it is a
+   * reload, the error is kept for lastError().
+   *
+   * @param reload if true, the file is being saved and failing is expected
+   */
+  void load(std::string              file,
+            std::shared_ptr<Texture> target,
+            bool                     reload = false);
+
+  /**
+   * @brief Upload decoded textures, must be called from the render thread
+   *
+   * At least one texture is uploaded if any is ready, then it stops as soon as
+   * maxBytes is reached.
+   *
+   * @param maxBytes the upload budget for this call
+   * @return unsigned the number of textures uploaded
+   */
+  unsigned processUploads(std::size_t maxBytes);
+
+  /**
+   * @brief Wait for all pending textures and upload them
+   *
+   */
+  void finish();
+
+  /**
+   * @brief Number of textures not uploaded yet
+   *
+   */
+  unsigned pending() const;
+
+  /**
+   * @brief Milliseconds from load() to upload of the last reload
+   *
+   */
+  float lastReloadTime() const { return mLastReloadTime; }
+
+  /**
+   * @brief Why the last texture that failed to load did, empty if none did
+   *
+   */
+  const std::string& lastError() const { return mLastError; }
+
+  /**
+   * @brief Why the last unreadable cooked texture was, its source was decoded
+   *
+   */
+  const std::string& lastCacheError() const { return mLastCacheError; }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Job
+  {
+    std::string              file;
+    std::shared_ptr<Texture> target;
+    bool                     reload;
+    Clock::time_point        requested;
+  };
+  struct Result
+  {
+    std::string              file;
+    TextureData              data;
+    std::shared_ptr<Texture> target;
+    bool                     reload;
+    Clock::time_point        requested;
+    std::string              error;
+    std::string              cacheError;
+  };
+
+  void mWork();
+  void mUpload(Result& result);
+
+private:
+  std::vector<std::thread> mWorkers;
+  mutable std::mutex       mMutex;
+  std::condition_variable  mJobAvailable;
+  std::condition_variable  mResultAvailable;
+  std::deque<Job>          mJobs;
+  std::deque<Result>       mResults;
+  unsigned                 mDecoding = 0;
+  bool                     mStopping = false;
+  unsigned                 mPixelBuffers[2]{0, 0};
+  unsigned                 mNextPixelBuffer = 0;
+  bool                     mCompressionSupported;
+  float                    mLastReloadTime = 0;
+  std::string              mLastError;
+  std::string              mLastCacheError;
+};
@@ -1,4 +1,6 @@
 #include "VoxelModel.hpp"
+#include <stdexcept>
+#include <string>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -14,17 +16,68 @@ struct Vertex
 {
   float x, y, z;
   float texR, texS;
+  float normalX, normalY, normalZ;
+  float tangentX, tangentY, tangentZ;
 };
 
-static Vertex vertices[] = {
+/// The TOP face, the others are rotations of it
+static Vertex quadVertices[] = {
   // first  vertex
-  {-.5f, -.5f, .5f, 1, 1},
+  {-.5f, -.5f, .5f, 1, 1, 0, 0, 1, 0, -1, 0},
   // second vertex
-  {.5f, -.5f, .5f, 0, 1},
+  {.5f, -.5f, .5f, 0, 1, 0, 0, 1, 0, -1, 0},
   // third vertex
-  {-.5f, .5f, .5f, 1, 0},
+  {-.5f, .5f, .5f, 1, 0, 0, 0, 1, 0, -1, 0},
   // fourth vertex
-  {.5f, .5f, .5f, 0, 0}};
+  {.5f, .5f, .5f, 0, 0, 0, 0, 1, 0, -1, 0}};
+
+constexpr unsigned FACE_COUNT = 6;
+
+/**
+ * @brief Rotation of each face, in VoxelFace bit order
+ *
+ */
+static glm::mat4
+faceRotation(unsigned face)
+{
+  static glm::vec3 yAxis(0, 1, 0);
+  static glm::vec3 xAxis(1, 0, 0);
+  switch (1 << face) {
+    case LEFT:
+      return glm::rotate(glm::radians(-90.f), yAxis);
+    case RIGHT:
+      return glm::rotate(glm::radians(90.f), yAxis);
+    case NEAR:
+      return glm::rotate(glm::radians(90.f), xAxis);
+    case FAR:
+      return glm::rotate(glm::radians(-90.f), xAxis);
+    case BOTTOM:
+      return glm::rotate(glm::radians(180.f), yAxis);
+    default:
+      return glm::mat4(1.f);
+  }
+}
+
+FaceVertex
+faceVertex(unsigned face, unsigned corner)
+{
+  auto  rotation   = faceRotation(face);
+  auto& quadVertex = quadVertices[corner];
+  auto  position =
+    rotation * glm::vec4(quadVertex.x, quadVertex.y, quadVertex.z, 1);
+  auto normal = rotation * glm::vec4(quadVertex.normalX,
+                                     quadVertex.normalY,
+                                     quadVertex.normalZ,
+                                     0);
+  auto tangent = rotation * glm::vec4(quadVertex.tangentX,
+                                      quadVertex.tangentY,
+                                      quadVertex.tangentZ,
+                                      0);
+  return {glm::vec3(position),
+          glm::vec3(normal),
+          glm::vec2(quadVertex.texR, quadVertex.texS),
+          glm::vec3(tangent)};
+}
 
 string
 getShaderType(VoxelDetailType detailType)
@@ -43,6 +96,24 @@ getShaderType(VoxelDetailType detailType)
 
 VoxelModel::VoxelModel()
 {
+  // All faces baked, so the shaders get their orientation as attributes
+  Vertex vertices[FACE_COUNT * 4];
+  for (unsigned face = 0; face < FACE_COUNT; ++face) {
+    for (unsigned i = 0; i < 4; ++i) {
+      auto corner            = faceVertex(face, i);
+      vertices[face * 4 + i] = {corner.position.x,
+                                corner.position.y,
+                                corner.position.z,
+                                corner.texCoord.x,
+                                corner.texCoord.y,
+                                corner.normal.x,
+                                corner.normal.y,
+                                corner.normal.z,
+                                corner.tangent.x,
+                                corner.tangent.y,
+                                corner.tangent.z};
+    }
+  }
   glGenBuffers(1, &mVbo);
   glBindBuffer(GL_ARRAY_BUFFER, mVbo);
   glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
@@ -53,18 +124,19 @@ VoxelModel::~VoxelModel()
   glDeleteBuffers(1, &mVbo);
 }
 
-void
-VoxelModel::render(const RenderInfo& renderInfo) const
+const ShaderProgram*
+useRenderInfo(const RenderInfo& renderInfo, const ResourcePool& pool)
 {
-  static glm::vec3 yAxis(0, 1, 0);
-  static glm::vec3 xAxis(1, 0, 0);
-
-  auto& shaderProgram = renderInfo.shaderProgram;
+  auto shaderProgram = pool.shaderProgram(renderInfo.shaderProgram);
+  if (!shaderProgram) {
+    return nullptr;
+  }
   glUseProgram(shaderProgram->shaderProgramId());
 
   int modelLoc      = shaderProgram->getUniformLocation("model");
   int viewLoc       = shaderProgram->getUniformLocation("view");
   int projectionLoc = shaderProgram->getUniformLocation("projection");
+  int normalLoc     = shaderProgram->getUniformLocation("normalMatrix");
   int tintLoc       = shaderProgram->getUniformLocation("tint");
   int ambient       = shaderProgram->getUniformLocation("ambient");
   int diffuse       = shaderProgram->getUniformLocation("diffuse");
@@ -74,6 +146,9 @@ VoxelModel::render(const RenderInfo& renderInfo) const
   glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(renderInfo.view));
   glUniformMatrix4fv(
     projectionLoc, 1, GL_FALSE, glm::value_ptr(renderInfo.projection));
+  glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(renderInfo.model));
+  glUniformMatrix3fv(
+    normalLoc, 1, GL_FALSE, glm::value_ptr(renderInfo.normalMatrix));
   glUniform4fv(tintLoc, 1, glm::value_ptr(renderInfo.tintColor));
   glUniform1f(ambient, renderInfo.lightProperty.ambient);
   glUniform1f(diffuse, renderInfo.lightProperty.diffuse);
@@ -82,77 +157,68 @@ VoxelModel::render(const RenderInfo& renderInfo) const
   glUniform4fv(
     lightSource, 1, glm::value_ptr(glm::normalize(renderInfo.lightSource)));
 
+  glUniform1f(shaderProgram->getUniformLocation("reliefStepsPerPixel"),
+              renderInfo.reliefProperty.stepsPerPixel);
+  glUniform1i(shaderProgram->getUniformLocation("reliefMinSteps"),
+              renderInfo.reliefProperty.minSteps);
+
   glUniform1i(
     glGetUniformLocation(shaderProgram->shaderProgramId(), "inputTex"), 0);
   glUniform1i(
     glGetUniformLocation(shaderProgram->shaderProgramId(), "reliefTex"), 1);
 
   // Setup textures
-  if (renderInfo.surfaceTexture) {
-    renderInfo.surfaceTexture->activate(GL_TEXTURE0);
+  if (auto surfaceTexture = pool.texture(renderInfo.surfaceTexture)) {
+    surfaceTexture->activate(GL_TEXTURE0);
+  }
+  if (auto reliefTexture = pool.texture(renderInfo.reliefTexture)) {
+    reliefTexture->activate(GL_TEXTURE1);
   }
-  if (renderInfo.reliefTexture) {
-    renderInfo.reliefTexture->activate(GL_TEXTURE1);
+  return shaderProgram;
+}
+
+void
+VoxelModel::render(const RenderInfo& renderInfo, const ResourcePool& pool) const
+{
+  if (!useRenderInfo(renderInfo, pool)) {
+    return;
   }
 
+  glBindBuffer(GL_ARRAY_BUFFER, mVbo);
+
   // position attribute
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
   glEnableVertexAttribArray(0);
 
+  // normal attribute
+  glVertexAttribPointer(1,
+                        3,
+                        GL_FLOAT,
+                        GL_FALSE,
+                        sizeof(Vertex),
+                        (void*)offsetof(Vertex, normalX));
+  glEnableVertexAttribArray(1);
+
   // texture attribute
   glVertexAttribPointer(
     2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texR));
   glEnableVertexAttribArray(2);
 
-  glBindBuffer(GL_ARRAY_BUFFER, mVbo);
-
-  if (renderInfo.faceBitSet & TOP) {
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(renderInfo.model));
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  }
-
-  if (renderInfo.faceBitSet & BOTTOM) {
-    glUniformMatrix4fv(modelLoc,
-                       1,
-                       GL_FALSE,
-                       glm::value_ptr(renderInfo.model *
-                                      glm::rotate(glm::radians(180.f), yAxis)));
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  }
-
-  if (renderInfo.faceBitSet & RIGHT) {
-    glUniformMatrix4fv(modelLoc,
-                       1,
-                       GL_FALSE,
-                       glm::value_ptr(renderInfo.model *
-                                      glm::rotate(glm::radians(90.f), yAxis)));
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  }
-
-  if (renderInfo.faceBitSet & LEFT) {
-    glUniformMatrix4fv(modelLoc,
-                       1,
-                       GL_FALSE,
-                       glm::value_ptr(renderInfo.model *
-                                      glm::rotate(glm::radians(-90.f), yAxis)));
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  }
-
-  if (renderInfo.faceBitSet & NEAR) {
-    glUniformMatrix4fv(modelLoc,
-                       1,
-                       GL_FALSE,
-                       glm::value_ptr(renderInfo.model *
-                                      glm::rotate(glm::radians(90.f), xAxis)));
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-  }
-
-  if (renderInfo.faceBitSet & FAR) {
-    glUniformMatrix4fv(modelLoc,
-                       1,
-                       GL_FALSE,
-                       glm::value_ptr(renderInfo.model *
-                                      glm::rotate(glm::radians(-90.f), xAxis)));
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+  // tangent attribute
+  glVertexAttribPointer(3,
+                        3,
+                        GL_FLOAT,
+                        GL_FALSE,
+                        sizeof(Vertex),
+                        (void*)offsetof(Vertex, tangentX));
+  glEnableVertexAttribArray(3);
+
+  // Section occlusion, left pointing at the last section mesh drawn
+  glDisableVertexAttribArray(4);
+
+  for (unsigned face = 0; face < FACE_COUNT; ++face) {
+    if (renderInfo.faceBitSet & (1 << face)) {
+      glDrawArrays(GL_TRIANGLE_STRIP, face * 4, 4);
+    }
   }
 }
@@ -1,7 +1,10 @@
 #pragma once
+#include <glm/glm.hpp>
 
 // Forward declarations
 class RenderInfo;
+class ResourcePool;
+class ShaderProgram;
 
 enum class VoxelDetailType
 {
@@ -10,6 +13,34 @@ enum class VoxelDetailType
   GOURAND
 };
 
+/**
+ * @brief A corner of a voxel face, relative to the voxel center
+ *
+ */
+struct FaceVertex
+{
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec2 texCoord;
+  glm::vec3 tangent;
+};
+
+/**
+ * @brief Get a face corner, as VoxelModel draws it
+ *
+ * @param face the face, in VoxelFace bit order
+ * @param corner 0 to 3, in triangle strip order
+ */
+FaceVertex faceVertex(unsigned face, unsigned corner);
+
+/**
+ * @brief Make the renderInfo program current, with its uniforms and textures
+ *
+ * @return the program, or nullptr if it is not available
+ */
+const ShaderProgram* useRenderInfo(const RenderInfo&   renderInfo,
+                                   const ResourcePool& pool);
+
 /**
  * @brief A voxel model
  *
@@ -27,8 +58,10 @@ public:
   /**
    * @brief Render the face
    *
+   * @param renderInfo what to render
+   * @param pool where renderInfo handles are resolved
    */
-  void render(const RenderInfo& renderInfo) const;
+  void render(const RenderInfo& renderInfo, const ResourcePool& pool) const;
 
 private:
   unsigned int mVbo;
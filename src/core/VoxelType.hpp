@@ -5,6 +5,8 @@ struct VoxelType
 {
   std::string surfaceTexture;
   std::string reliefTexture;
+  /// Block light level it gives off, 0 to MAX_LIGHT_LEVEL
+  unsigned emission = 0;
 
   VoxelType& withSurface(std::string value)
   {
@@ -17,4 +19,10 @@ struct VoxelType
     reliefTexture = std::move(value);
     return *this;
   }
+
+  VoxelType& withEmission(unsigned value)
+  {
+    emission = value;
+    return *this;
+  }
 };
\ No newline at end of file
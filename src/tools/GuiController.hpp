@@ -16,7 +16,8 @@ struct GuiController
   ImVec4      clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
   SDL_Window* window;
   Texture     fontTexture;
-  std::shared_ptr<ShaderProgram> mShader;
+  ResourcePool* pool;
+  ShaderHandle  mShader;
   int attribLocationTex = 0, attribLocationProjMtx = 0;
   int attribLocationPosition = 0, attribLocationUV = 0, attribLocationColor = 0;
   unsigned int vboHandle = 0, elementsHandle = 0;
@@ -25,6 +26,7 @@ struct GuiController
                 SDL_GLContext gl_context,
                 ResourcePool* pool)
     : window(window)
+    , pool(pool)
   {
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -92,13 +94,14 @@ struct GuiController
 #endif
     ImGui::StyleColorsDark();
     mShader               = pool->getShaderProgram("imgui_330");
-    attribLocationTex     = mShader->getUniformLocation("Texture");
-    attribLocationProjMtx = mShader->getUniformLocation("ProjMtx");
+    auto shader           = pool->shaderProgram(mShader);
+    attribLocationTex     = shader->getUniformLocation("Texture");
+    attribLocationProjMtx = shader->getUniformLocation("ProjMtx");
     attribLocationPosition =
-      glGetAttribLocation(mShader->shaderProgramId(), "Position");
-    attribLocationUV = glGetAttribLocation(mShader->shaderProgramId(), "UV");
+      glGetAttribLocation(shader->shaderProgramId(), "Position");
+    attribLocationUV = glGetAttribLocation(shader->shaderProgramId(), "UV");
     attribLocationColor =
-      glGetAttribLocation(mShader->shaderProgramId(), "Color");
+      glGetAttribLocation(shader->shaderProgramId(), "Color");
 
     // Create buffers
     glGenBuffers(1, &vboHandle);
@@ -289,7 +292,7 @@ struct GuiController
       {0.0f, 0.0f, -1.0f, 0.0f},
       {(R + L) / (L - R), (T + B) / (B - T), 0.0f, 1.0f},
     };
-    glUseProgram(mShader->shaderProgramId());
+    glUseProgram(pool->shaderProgram(mShader)->shaderProgramId());
     glUniform1i(attribLocationTex, 0);
     glUniformMatrix4fv(
       attribLocationProjMtx, 1, GL_FALSE, &ortho_projection[0][0]);
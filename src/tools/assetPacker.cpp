@@ -0,0 +1,60 @@
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "util/assetArchive.hpp"
+#include "util/fileReader.hpp"
+
+using namespace std;
+
+/**
+ * Bundles files into a single archive, that can be mounted with
+ * mountArchive(). Directories are added recursively, with paths relative to
+ * the working directory.
+ *
+ * Usage: assetPacker archive path...
+ */
+int
+main(int argc, char const* argv[])
+{
+  if (argc < 3) {
+    cerr << "Usage: " << argv[0] << " archive path..." << endl;
+    return EXIT_FAILURE;
+  }
+  vector<string> paths;
+  for (int argIndex = 2; argIndex < argc; ++argIndex) {
+    filesystem::path path = argv[argIndex];
+    if (!filesystem::is_directory(path)) {
+      paths.push_back(path.generic_string());
+      continue;
+    }
+    for (auto& entry : filesystem::recursive_directory_iterator(path)) {
+      if (entry.is_regular_file()) {
+        paths.push_back(entry.path().generic_string());
+      }
+    }
+  }
+  // Same input, same archive
+  sort(paths.begin(), paths.end());
+
+  vector<pair<string, string>> files;
+  try {
+    for (auto& path : paths) {
+      files.emplace_back(path, readFile(path.c_str()));
+    }
+  } catch (const exception& e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  auto     archive = packAssets(files);
+  ofstream output(argv[1], ios::binary);
+  output.write(archive.data(), archive.size());
+  if (!output) {
+    cerr << "Can not write " << argv[1] << endl;
+    return EXIT_FAILURE;
+  }
+  cout << argv[1] << ": " << files.size() << " files, " << archive.size()
+       << " bytes" << endl;
+  return EXIT_SUCCESS;
+}
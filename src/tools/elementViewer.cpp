@@ -10,6 +10,7 @@
 #include "core/RenderInfo.hpp"
 #include "core/ResourcePool.hpp"
 #include "core/VoxelModel.hpp"
+#include "util/assetArchive.hpp"
 
 constexpr int WINDOW_DEFAULT_W = 800;
 constexpr int WINDOW_DEFAULT_H = 600;
@@ -35,6 +36,10 @@ main(int argc, char const* argv[])
     return EXIT_FAILURE;
   }
 
+  if (mountArchive(ASSET_ARCHIVE_FILE)) {
+    cout << "Using assets from " << ASSET_ARCHIVE_FILE << endl;
+  }
+
   if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
     cerr << "Can not initialize SDL2 " << SDL_GetError() << endl;
     return EXIT_FAILURE;
@@ -172,6 +177,8 @@ main(int argc, char const* argv[])
       rotationY -= delta * rotationSpeed;
     }
 
+    resourcePool.update();
+
     // Clear and Setup frame
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glBindVertexArray(VAO);
@@ -181,6 +188,8 @@ main(int argc, char const* argv[])
       glm::rotate(glm::radians(rotationX), glm::vec3(-1, 0, 0)) *
       glm::rotate(glm::radians(rotationY), glm::vec3(0, 0, 1));
     renderInfo.view = camera.makeView();
+    renderInfo.normalMatrix = glm::transpose(
+      glm::inverse(glm::mat3(renderInfo.view * renderInfo.model)));
     renderInfo.projection =
       glm::perspective(glm::radians(fov),
                        float(WINDOW_DEFAULT_W) / WINDOW_DEFAULT_H,
@@ -188,7 +197,7 @@ main(int argc, char const* argv[])
                        100.0f);
 
     // Render objects
-    voxel.render(renderInfo);
+    voxel.render(renderInfo, resourcePool);
 
     // Present
     SDL_GL_SwapWindow(window);
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <GL/glew.h>
+#include <SDL.h>
+#include "core/ResourcePool.hpp"
+
+using namespace std;
+
+/// Counts every allocation done in this process
+static size_t allocationCount = 0;
+
+void*
+operator new(size_t size)
+{
+  ++allocationCount;
+  if (auto pointer = malloc(size ? size : 1)) {
+    return pointer;
+  }
+  throw bad_alloc();
+}
+
+void
+operator delete(void* pointer) noexcept
+{
+  free(pointer);
+}
+
+void
+operator delete(void* pointer, size_t) noexcept
+{
+  free(pointer);
+}
+
+constexpr unsigned ITERATIONS = 1000000;
+
+/**
+ * @brief Time a lookup that hits the pool and count its allocations
+ *
+ */
+template<class LOOKUP>
+static void
+benchmark(const char* name, ResourcePool& pool, LOOKUP lookup)
+{
+  // Hold a reference, so the first miss is not measured and unreferenced
+  // materials are not dropped between iterations
+  auto held = lookup();
+
+  auto allocations = allocationCount;
+  auto start       = chrono::steady_clock::now();
+  for (unsigned i = 0; i < ITERATIONS; ++i) {
+    pool.release(lookup());
+  }
+  auto elapsed = chrono::steady_clock::now() - start;
+  allocations  = allocationCount - allocations;
+  pool.release(held);
+  cout << name << ": "
+       << chrono::duration<double, nano>(elapsed).count() / ITERATIONS
+       << " ns, " << double(allocations) / ITERATIONS << " allocations"
+       << endl;
+}
+
+/**
+ * Measures the hit path of ResourcePool lookups.
+ *
+ * Usage: resourceBenchmark
+ */
+int
+main(int argc, char const* argv[])
+{
+  if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    cerr << "Can not initialize SDL2 " << SDL_GetError() << endl;
+    return EXIT_FAILURE;
+  }
+  atexit(SDL_Quit);
+
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+  SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+  SDL_Window* window = SDL_CreateWindow("resourceBenchmark",
+                                        SDL_WINDOWPOS_UNDEFINED,
+                                        SDL_WINDOWPOS_UNDEFINED,
+                                        64,
+                                        64,
+                                        SDL_WINDOW_HIDDEN | SDL_WINDOW_OPENGL);
+  if (window == nullptr) {
+    cerr << "Can not create window SDL2 " << SDL_GetError() << endl;
+    return EXIT_FAILURE;
+  }
+  SDL_GL_CreateContext(window);
+  if (GLenum err = glewInit(); err != GLEW_OK) {
+    cerr << "Error: " << glewGetErrorString(err) << endl;
+    return EXIT_FAILURE;
+  }
+
+  ResourcePool pool;
+  benchmark("getShaderProgram", pool, [&] {
+    return pool.getShaderProgram("simple");
+  });
+  ShaderDefines defines = {{"PARALLAX", 0}, {"SELF_SHADOW", 0}};
+  benchmark("getShaderProgram with defines", pool, [&] {
+    return pool.getShaderProgram("relief", defines);
+  });
+  benchmark("getTexture", pool, [&] {
+    return pool.getTexture("res/rockwall.jpg");
+  });
+  benchmark("getMaterial", pool, [&] {
+    return pool.getMaterial("res/rockwall.jpg", "res/rockwall.png");
+  });
+  pool.finishLoading();
+  return EXIT_SUCCESS;
+}
@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include <iostream>
+#include <random>
 #include <sstream>
 #include <GL/glew.h>
 #include <SDL.h>
@@ -10,11 +11,14 @@
 #include "GuiController.hpp"
 #include "core/Camera.hpp"
 #include "core/Chunk.hpp"
+#include "core/LightVolumeComponent.hpp"
 #include "core/LoaderComponent.hpp"
 #include "core/PerspectiveRenderComponent.hpp"
 #include "core/ResourcePool.hpp"
 #include "core/Scene.hpp"
+#include "core/SectionMeshComponent.hpp"
 #include "core/VoxelType.hpp"
+#include "util/assetArchive.hpp"
 
 constexpr int WINDOW_DEFAULT_W = 1200;
 constexpr int WINDOW_DEFAULT_H = 796;
@@ -40,10 +44,15 @@ enum class ShapeSize : int
 };
 
 void
-makeSceneShape(const shared_ptr<LoaderComponent>& loader,
-               Shape                              shape,
-               ShapeSize                          size,
-               unsigned                           baseVoxel);
+makeSceneShape(const vector<shared_ptr<LoaderComponent>>& loaders,
+               Shape                                      shape,
+               ShapeSize                                  size,
+               unsigned                                   baseVoxel);
+
+void
+scatterLights(vector<PointLight>& lights,
+              unsigned            count,
+              const glm::vec3&    center);
 
 int
 main(int argc, char const* argv[])
@@ -51,6 +60,10 @@ main(int argc, char const* argv[])
   string surfaceTexture = "res/tile1.jpg";
   string reliefTexture  = "res/tile1.png";
 
+  if (mountArchive(ASSET_ARCHIVE_FILE)) {
+    cout << "Using assets from " << ASSET_ARCHIVE_FILE << endl;
+  }
+
   if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
     cerr << "Can not initialize SDL2 " << SDL_GetError() << endl;
     return EXIT_FAILURE;
@@ -116,16 +129,31 @@ main(int argc, char const* argv[])
   ResourcePool  resourcePool;
   GuiController controller(window, glContext, &resourcePool);
   Scene         scene(&camera);
-  auto          loaderComponent = make_shared<LoaderComponent>();
+  auto          meshComponent   = make_shared<SectionMeshComponent>();
+  auto          lightComponent  = make_shared<LightVolumeComponent>();
   auto          renderComponent = make_shared<PerspectiveRenderComponent>(
     &resourcePool, WINDOW_DEFAULT_W, WINDOW_DEFAULT_H);
-  scene.insertComponent(loaderComponent);
+  renderComponent->useSectionMeshes(meshComponent);
+  renderComponent->lightVolume = lightComponent;
+  // The chunk ring, then each clipmap around it
+  vector<shared_ptr<LoaderComponent>> loaders;
+  for (unsigned level = 0; level <= CLIPMAP_LEVELS; ++level) {
+    auto loader   = make_shared<LoaderComponent>();
+    loader->level = level;
+    scene.insertComponent(loader);
+    loaders.push_back(loader);
+  }
+  lightComponent->loader = loaders[0];
+  scene.insertComponent(meshComponent);
+  scene.insertComponent(lightComponent);
   scene.insertComponent(renderComponent);
 
   Shape     shape     = Shape::PLANE_XY;
   ShapeSize shapeSize = ShapeSize::INFINITE;
-  auto      baseVoxel = renderComponent->insertVoxelType(
-    VoxelType{}.withSurface(surfaceTexture).withRelief(reliefTexture));
+  auto      baseType =
+    VoxelType{}.withSurface(surfaceTexture).withRelief(reliefTexture);
+  auto      baseVoxel = renderComponent->insertVoxelType(baseType);
+  lightComponent->insertVoxelType(baseType);
   float clearColor[4] = {.25f, .65f, .999f, 1.f};
 
   bool mouseGrab = false;
@@ -138,6 +166,11 @@ main(int argc, char const* argv[])
   float  mouseSensitivity = 0.05f;
   float  lodFarPercent    = renderComponent->farLod * 100;
   float  lodMiddlePercent = renderComponent->middleLod * 100;
+  int    tilesPerFrame    = loaders[0]->tilesPerFrame;
+  int    sectionsPerFrame = meshComponent->sectionsPerFrame;
+  int    lightSteps       = lightComponent->stepsPerFrame >> 10;
+  int    budgetMb         = resourcePool.budget() >> 20;
+  int    pointLightCount  = 0;
 
   unsigned int VAO;
   glGenVertexArrays(1, &VAO);
@@ -206,10 +239,19 @@ main(int argc, char const* argv[])
     }
     // Update
     camera.rotateTo(angleH, angleV);
-    renderComponent->middleLod = lodMiddlePercent / 100.f;
-    renderComponent->farLod    = lodFarPercent / 100.f;
-    makeSceneShape(loaderComponent, shape, shapeSize, baseVoxel);
+    renderComponent->middleLod      = lodMiddlePercent / 100.f;
+    renderComponent->farLod         = lodFarPercent / 100.f;
+    meshComponent->sectionsPerFrame = sectionsPerFrame;
+    lightComponent->stepsPerFrame   = unsigned(lightSteps) << 10;
+    for (auto& loader : loaders) {
+      loader->tilesPerFrame = tilesPerFrame;
+    }
+    resourcePool.budget(size_t(budgetMb) << 20);
+    makeSceneShape(loaders, shape, shapeSize, baseVoxel);
+    scatterLights(
+      renderComponent->pointLights, pointLightCount, initalCameraPos);
     scene.update(delta);
+    resourcePool.update();
 
     // Clear and Setup frame
     glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
@@ -222,7 +264,20 @@ main(int argc, char const* argv[])
     {
       ImGui::Begin("Tweaks");
       ImGui::Text("FPS %.2f", frameRate);
-      ImGui::Text("Voxels Rendered %d", renderComponent->voxelsRendered);
+      ImGui::Text("Voxels Rendered %d of %d visited",
+                  renderComponent->voxelsRendered,
+                  renderComponent->voxelsVisited);
+      ImGui::Text("Sections Rendered %d, %d triangles",
+                  renderComponent->sectionsRendered,
+                  renderComponent->sectionTriangles);
+      if (auto& impostorAtlas = renderComponent->impostorAtlas) {
+        ImGui::Text("Impostors Rendered %d, %d snapshots taken",
+                    renderComponent->impostorsRendered,
+                    impostorAtlas->captures());
+      }
+      if (auto pending = resourcePool.pendingTextures()) {
+        ImGui::Text("Loading Textures %d", pending);
+      }
       ImGui::Combo("Shape",
                    reinterpret_cast<int*>(&shape),
                    "PLANE XY\0SOLID CUBE\0WIRE CUBE\0SPHERE\0");
@@ -232,6 +287,11 @@ main(int argc, char const* argv[])
                    "   10\0  100\0 1000\0INFIN\0");
       ImGui::ColorEdit3("Clear Color", clearColor);
       ImGui::Checkbox("VSync", &vSync);
+      ImGui::Checkbox("Depth Pre-pass", &renderComponent->depthPrePass);
+      ImGui::Checkbox("Deferred Shading", &renderComponent->deferredShading);
+      ImGui::Checkbox("Shadows", &renderComponent->shadows);
+      ImGui::Checkbox("Mesh Far Band", &renderComponent->meshFarBand);
+      ImGui::Checkbox("Impostors", &renderComponent->impostors);
       if (vSync) {
         if (SDL_GL_GetSwapInterval() == 0) {
           if (SDL_GL_SetSwapInterval(1) < 0) {
@@ -250,10 +310,28 @@ main(int argc, char const* argv[])
       if (ImGui::CollapsingHeader("Projection")) {
         ImGui::LabelText("Projection Type", "Perspective");
         ImGui::SliderFloat("near", &near, 0.125f, 5.f);
-        ImGui::SliderFloat("far", &far, 50.f, 500.f);
+        ImGui::SliderFloat("far", &far, 50.f, 2000.f);
         ImGui::SliderFloat("FOV", &fov, 1.f, 45.f);
       }
 
+      if (ImGui::CollapsingHeader("Resolution")) {
+        ImGui::Text("Frame Time %.2f ms GPU, %.2f ms CPU",
+                    renderComponent->gpuFrameTime,
+                    renderComponent->cpuFrameTime);
+        ImGui::Checkbox("Dynamic Resolution",
+                        &renderComponent->scaleResolution);
+        ImGui::SliderFloat("Target Frame Time",
+                           &renderComponent->targetFrameTime,
+                           4.f,
+                           50.f,
+                           "%.1f ms");
+        // Overwritten by Dynamic Resolution, when on
+        ImGui::SliderFloat("Resolution Scale",
+                           &renderComponent->resolutionScale,
+                           MIN_RESOLUTION_SCALE,
+                           1.f);
+      }
+
       if (ImGui::CollapsingHeader("Camera", ImGuiTreeNodeFlags_DefaultOpen)) {
         ImGui::DragFloat3("Cam Pos", &camera.position().x);
         ImGui::SliderFloat("Horizontal Angle", &angleH, 0, 360);
@@ -269,6 +347,76 @@ main(int argc, char const* argv[])
         ImGui::SliderFloat("Far Limit", &lodFarPercent, 0, 100, "%.2f%%");
         ImGui::SliderFloat(
           "Middle Limit", &lodMiddlePercent, 0, lodFarPercent, "%.2f%%");
+        ImGui::SliderFloat(
+          "Mesh LOD Distance", &meshComponent->lodDistance, 16.f, 256.f);
+        ImGui::SliderFloat(
+          "Impostor Start", &renderComponent->impostorStart, 128.f, 2000.f);
+        ImGui::Combo("Relief Quality",
+                     reinterpret_cast<int*>(&renderComponent->reliefQuality),
+                     "LOW\0MEDIUM\0HIGH\0");
+        ImGui::SliderFloat("Relief Steps per Pixel",
+                           &renderComponent->reliefProperty.stepsPerPixel,
+                           0.125f,
+                           2.f);
+        ImGui::SliderInt(
+          "Relief Min Steps", &renderComponent->reliefProperty.minSteps, 1, 15);
+      }
+
+      if (ImGui::CollapsingHeader("Lights")) {
+        if (auto& cascades = renderComponent->shadowCascades) {
+          ImGui::Text("Shadow Cascade Renders %d", cascades->renders());
+        }
+        ImGui::SliderInt("Point Lights", &pointLightCount, 0, 512);
+        ImGui::Text("Cluster Light References %d",
+                    renderComponent->lightClusters.assignedLights());
+        if (!renderComponent->deferredShading) {
+          ImGui::Text("Point lights need Deferred Shading");
+        }
+        ImGui::Checkbox("Voxel Light", &renderComponent->voxelLight);
+        ImGui::Text("Pending Light Steps %d", lightComponent->pendingSteps());
+        ImGui::SliderInt("Light Steps per Frame (K)", &lightSteps, 16, 2048);
+      }
+
+      if (ImGui::CollapsingHeader("Loader")) {
+        for (auto& loader : loaders) {
+          ImGui::Text("Level %d: Pending Tiles %d, Cancelled Tiles %d",
+                      loader->level,
+                      int(loader->requests.size()),
+                      loader->cancelledRequests);
+        }
+        ImGui::SliderInt("Tiles per Frame", &tilesPerFrame, 1, 64);
+        ImGui::Text("Pending Sections %d",
+                    int(meshComponent->pendingSections.size()));
+        ImGui::SliderInt("Sections per Frame", &sectionsPerFrame, 1, 64);
+      }
+
+      if (ImGui::CollapsingHeader("Resources")) {
+        auto& stats = resourcePool.stats();
+        ImGui::Text("Textures %.1f MB", stats.textureBytes / 1048576.f);
+        ImGui::Text("Shaders %.1f MB", stats.shaderBytes / 1048576.f);
+        ImGui::Text("Evictions %d", stats.evictions);
+        ImGui::Text("Reloads %d", stats.reloads);
+        ImGui::Text("Relief Textures %d",
+                    renderComponent->residentReliefTextures);
+        ImGui::SliderInt("Budget MB", &budgetMb, 16, 2048);
+        ImGui::Text("Shader Hot Reloads %d, last %.1f ms",
+                    stats.shaderHotReloads,
+                    stats.shaderReloadTime);
+        ImGui::Text("Texture Hot Reloads %d, last %.1f ms",
+                    stats.textureHotReloads,
+                    stats.textureReloadTime);
+        if (!stats.hotReloadError.empty()) {
+          ImGui::TextColored(
+            ImVec4(1, .4f, .4f, 1), "%s", stats.hotReloadError.c_str());
+        }
+        if (!stats.textureLoadError.empty()) {
+          ImGui::TextColored(
+            ImVec4(1, .4f, .4f, 1), "%s", stats.textureLoadError.c_str());
+        }
+        if (!stats.textureCacheError.empty()) {
+          ImGui::TextColored(
+            ImVec4(1, .4f, .4f, 1), "%s", stats.textureCacheError.c_str());
+        }
       }
 
       ImGui::Separator();
@@ -304,10 +452,10 @@ main(int argc, char const* argv[])
 }
 
 void
-makeSceneShape(const shared_ptr<LoaderComponent>& loader,
-               Shape                              shape,
-               ShapeSize                          size,
-               unsigned                           baseVoxel)
+makeSceneShape(const vector<shared_ptr<LoaderComponent>>& loaders,
+               Shape                                      shape,
+               ShapeSize                                  size,
+               unsigned                                   baseVoxel)
 {
   static Shape     oldShape = Shape::UNDEFINED;
   static ShapeSize oldSize  = ShapeSize::UNDEFINED;
@@ -317,13 +465,16 @@ makeSceneShape(const shared_ptr<LoaderComponent>& loader,
   oldShape         = shape;
   oldSize          = size;
   int sizeInVoxels = pow(10, static_cast<int>(size) + 1);
+  // Sampled once per cell, so clipmaps get the same shape coarser
+  SceneLoader generator;
   switch (shape) {
     case Shape::PLANE_XY:
       if (size == ShapeSize::INFINITE) {
-        loader->sceneGenerator([baseVoxel](const glm::ivec3& lowerBound,
-                                           const glm::ivec3& higherBound,
-                                           const glm::ivec3& offset,
-                                           Chunk*            chunk) {
+        generator = [baseVoxel](const glm::ivec3& lowerBound,
+                                const glm::ivec3& higherBound,
+                                const glm::ivec3& offset,
+                                int               cellSide,
+                                Chunk*            chunk) {
           for (int i = lowerBound.z; i < higherBound.z; ++i) {
             for (int j = lowerBound.y; j < higherBound.y; ++j) {
               for (int k = lowerBound.x; k < higherBound.x; ++k) {
@@ -336,44 +487,21 @@ makeSceneShape(const shared_ptr<LoaderComponent>& loader,
               }
             }
           }
-        });
+        };
       } else {
-        loader->sceneGenerator(
-          [baseVoxel, sizeInVoxels](const glm::ivec3& lowerBound,
-                                    const glm::ivec3& higherBound,
-                                    const glm::ivec3& offset,
-                                    Chunk*            chunk) {
-            for (int i = lowerBound.z; i < higherBound.z; ++i) {
-              for (int j = lowerBound.y; j < higherBound.y; ++j) {
-                for (int k = lowerBound.x; k < higherBound.x; ++k) {
-                  auto pos = glm::ivec3(k, j, i);
-                  if ((pos.x + offset.x < sizeInVoxels && pos.x >= offset.x) &&
-                      (pos.y + offset.y < sizeInVoxels && pos.y >= offset.y) &&
-                      pos.z == -offset.z) {
-                    chunk->at(pos).blockType = baseVoxel;
-                  } else {
-                    chunk->at(pos).blockType = NO_BLOCK;
-                  }
-                }
-              }
-            }
-          });
-      }
-      break;
-    case Shape::SOLID_CUBE:
-      loader->sceneGenerator(
-        [baseVoxel, sizeInVoxels](const glm::ivec3& lowerBound,
-                                  const glm::ivec3& higherBound,
-                                  const glm::ivec3& offset,
-                                  Chunk*            chunk) {
+        generator = [baseVoxel, sizeInVoxels](const glm::ivec3& lowerBound,
+                                              const glm::ivec3& higherBound,
+                                              const glm::ivec3& offset,
+                                              int               cellSide,
+                                              Chunk*            chunk) {
+          int sizeInCells = (sizeInVoxels + cellSide - 1) / cellSide;
           for (int i = lowerBound.z; i < higherBound.z; ++i) {
             for (int j = lowerBound.y; j < higherBound.y; ++j) {
               for (int k = lowerBound.x; k < higherBound.x; ++k) {
                 auto pos = glm::ivec3(k, j, i);
-
-                if ((pos.x + offset.x < sizeInVoxels && pos.x >= -offset.x) &&
-                    (pos.y + offset.y < sizeInVoxels && pos.y >= -offset.y) &&
-                    (pos.z + offset.z < sizeInVoxels && pos.z >= -offset.z)) {
+                if ((pos.x + offset.x < sizeInCells && pos.x >= offset.x) &&
+                    (pos.y + offset.y < sizeInCells && pos.y >= offset.y) &&
+                    pos.z == -offset.z) {
                   chunk->at(pos).blockType = baseVoxel;
                 } else {
                   chunk->at(pos).blockType = NO_BLOCK;
@@ -381,28 +509,54 @@ makeSceneShape(const shared_ptr<LoaderComponent>& loader,
               }
             }
           }
-        });
+        };
+      }
+      break;
+    case Shape::SOLID_CUBE:
+      generator = [baseVoxel, sizeInVoxels](const glm::ivec3& lowerBound,
+                                            const glm::ivec3& higherBound,
+                                            const glm::ivec3& offset,
+                                            int               cellSide,
+                                            Chunk*            chunk) {
+        int sizeInCells = (sizeInVoxels + cellSide - 1) / cellSide;
+        for (int i = lowerBound.z; i < higherBound.z; ++i) {
+          for (int j = lowerBound.y; j < higherBound.y; ++j) {
+            for (int k = lowerBound.x; k < higherBound.x; ++k) {
+              auto pos = glm::ivec3(k, j, i);
+
+              if ((pos.x + offset.x < sizeInCells && pos.x >= -offset.x) &&
+                  (pos.y + offset.y < sizeInCells && pos.y >= -offset.y) &&
+                  (pos.z + offset.z < sizeInCells && pos.z >= -offset.z)) {
+                chunk->at(pos).blockType = baseVoxel;
+              } else {
+                chunk->at(pos).blockType = NO_BLOCK;
+              }
+            }
+          }
+        }
+      };
       break;
     case Shape::WIRE_CUBE:
-      loader->sceneGenerator([baseVoxel,
-                              sizeInVoxels](const glm::ivec3& lowerBound,
+      generator = [baseVoxel, sizeInVoxels](const glm::ivec3& lowerBound,
                                             const glm::ivec3& higherBound,
                                             const glm::ivec3& offset,
+                                            int               cellSide,
                                             Chunk*            chunk) {
+        int lastCell = sizeInVoxels / cellSide;
         for (int i = lowerBound.z; i < higherBound.z; ++i) {
           for (int j = lowerBound.y; j < higherBound.y; ++j) {
             for (int k = lowerBound.x; k < higherBound.x; ++k) {
               auto pos    = glm::ivec3(k, j, i);
               auto effPos = pos + offset;
-              if (effPos.x <= sizeInVoxels && effPos.y <= sizeInVoxels &&
-                  (effPos.z == 0 || effPos.z == sizeInVoxels)) {
+              if (effPos.x <= lastCell && effPos.y <= lastCell &&
+                  (effPos.z == 0 || effPos.z == lastCell)) {
                 chunk->at(pos).blockType = baseVoxel;
-              } else if (effPos.x <= sizeInVoxels &&
-                         (effPos.y == 0 || effPos.y == sizeInVoxels) &&
-                         effPos.z <= sizeInVoxels) {
+              } else if (effPos.x <= lastCell &&
+                         (effPos.y == 0 || effPos.y == lastCell) &&
+                         effPos.z <= lastCell) {
                 chunk->at(pos).blockType = baseVoxel;
-              } else if ((effPos.x == 0 || effPos.x == sizeInVoxels) &&
-                         effPos.y <= sizeInVoxels && effPos.z <= sizeInVoxels) {
+              } else if ((effPos.x == 0 || effPos.x == lastCell) &&
+                         effPos.y <= lastCell && effPos.z <= lastCell) {
                 chunk->at(pos).blockType = baseVoxel;
               } else {
                 chunk->at(pos).blockType = NO_BLOCK;
@@ -410,33 +564,63 @@ makeSceneShape(const shared_ptr<LoaderComponent>& loader,
             }
           }
         }
-      });
+      };
       break;
     case Shape::SPHERE:
-      loader->sceneGenerator(
-        [baseVoxel, sizeInVoxels](const glm::ivec3& lowerBound,
-                                  const glm::ivec3& higherBound,
-                                  const glm::ivec3& offset,
-                                  Chunk*            chunk) {
-          float radius = sizeInVoxels / 2.f;
-          for (int i = lowerBound.z; i < higherBound.z; ++i) {
-            for (int j = lowerBound.y; j < higherBound.y; ++j) {
-              for (int k = lowerBound.x; k < higherBound.x; ++k) {
-                auto pos = glm::ivec3(k, j, i);
-                if (sqrtf(powf(pos.x + .5f + offset.x, 2) +
-                          powf(pos.y + .5f + offset.y, 2) +
-                          powf(pos.z + .5f + offset.z, 2)) <= radius) {
-                  chunk->at(pos).blockType = baseVoxel;
-                } else {
-                  chunk->at(pos).blockType = NO_BLOCK;
-                }
+      generator = [baseVoxel, sizeInVoxels](const glm::ivec3& lowerBound,
+                                            const glm::ivec3& higherBound,
+                                            const glm::ivec3& offset,
+                                            int               cellSide,
+                                            Chunk*            chunk) {
+        float radius = sizeInVoxels / 2.f / cellSide;
+        for (int i = lowerBound.z; i < higherBound.z; ++i) {
+          for (int j = lowerBound.y; j < higherBound.y; ++j) {
+            for (int k = lowerBound.x; k < higherBound.x; ++k) {
+              auto pos = glm::ivec3(k, j, i);
+              if (sqrtf(powf(pos.x + .5f + offset.x, 2) +
+                        powf(pos.y + .5f + offset.y, 2) +
+                        powf(pos.z + .5f + offset.z, 2)) <= radius) {
+                chunk->at(pos).blockType = baseVoxel;
+              } else {
+                chunk->at(pos).blockType = NO_BLOCK;
               }
             }
           }
-        });
+        }
+      };
       break;
     default:
       throw std::runtime_error("Unimplemented");
   }
-  loader->reset();
+  // The whole ring at once, the chunks still hold the previous shape
+  for (auto& loader : loaders) {
+    loader->sceneGenerator(generator);
+    loader->reset();
+    loader->flush();
+  }
+}
+
+void
+scatterLights(vector<PointLight>& lights,
+              unsigned            count,
+              const glm::vec3&    center)
+{
+  if (lights.size() == count) {
+    return;
+  }
+  // Seeded by index, so changing the count keeps the existing lights
+  for (unsigned i = lights.size(); i < count; ++i) {
+    mt19937                          random(i);
+    uniform_real_distribution<float> offset(-32.f, 32.f);
+    uniform_real_distribution<float> unit(0.f, 1.f);
+    PointLight                       light;
+    // Torch like, above the XY plane
+    light.position   = center + glm::vec3(offset(random), offset(random), 0);
+    light.position.z = .5f + unit(random) * 2;
+    light.radius     = 2.f + unit(random) * 4;
+    light.color      = glm::vec3(1.f, .5f + unit(random) * .4f, 0);
+    light.color.b    = unit(random) * .3f;
+    lights.push_back(light);
+  }
+  lights.resize(count);
 }
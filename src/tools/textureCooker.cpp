@@ -0,0 +1,55 @@
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include "core/Texture.hpp"
+#include "util/textureCooking.hpp"
+
+using namespace std;
+
+/**
+ * Converts source images into cooked textures, with precomputed mipmaps and
+ * block compression, into the cache directory.
+ *
+ * Usage: textureCooker [-u] image...
+ * -u stores the following images uncompressed.
+ */
+int
+main(int argc, char const* argv[])
+{
+  bool compress = true;
+  if (argc < 2) {
+    cerr << "Usage: " << argv[0] << " [-u] image..." << endl;
+    return EXIT_FAILURE;
+  }
+  for (int argIndex = 1; argIndex < argc; ++argIndex) {
+    if (argv[argIndex] == "-u"s) {
+      compress = false;
+      continue;
+    }
+    string sourcePath = argv[argIndex];
+    string cookedPath = cookedTexturePath(sourcePath);
+    try {
+      auto data   = TextureData::decode(sourcePath.c_str());
+      auto cooked = cookTexture(data.pixels.data(),
+                                data.width,
+                                data.height,
+                                data.format == PixelFormat::RGB8 ? 3 : 4,
+                                compress);
+      filesystem::create_directories(
+        filesystem::path(cookedPath).parent_path());
+      ofstream output(cookedPath, ios::binary);
+      output.write(cooked.data(), cooked.size());
+      if (!output) {
+        cerr << "Can not write " << cookedPath << endl;
+        return EXIT_FAILURE;
+      }
+      cout << sourcePath << " -> " << cookedPath << " (" << data.pixels.size()
+           << " -> " << cooked.size() << " bytes)" << endl;
+    } catch (const exception& e) {
+      cerr << sourcePath << ": " << e.what() << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  return EXIT_SUCCESS;
+}
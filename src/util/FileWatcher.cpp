@@ -0,0 +1,84 @@
+#include "FileWatcher.hpp"
+#include <algorithm>
+#include <filesystem>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+  mFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+  if (mFd >= 0) {
+    close(mFd);
+  }
+#endif
+}
+
+void
+FileWatcher::watch(const string& file)
+{
+  auto path = normalize(file);
+  if (mFd < 0 || !mFiles.insert(path).second) {
+    return;
+  }
+#ifdef __linux__
+  auto directory = filesystem::path(path).parent_path().string();
+  if (directory.empty()) {
+    directory = ".";
+  }
+  // The same directory gives back the same descriptor
+  int wd = inotify_add_watch(
+    mFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+  if (wd >= 0) {
+    mDirectories[wd] = directory == "." ? "" : directory + "/";
+  }
+#endif
+}
+
+vector<string>
+FileWatcher::poll()
+{
+  vector<string> changed;
+#ifdef __linux__
+  if (mFd < 0) {
+    return changed;
+  }
+  alignas(inotify_event) char buffer[4096];
+  for (;;) {
+    auto length = read(mFd, buffer, sizeof(buffer));
+    if (length <= 0) {
+      break;
+    }
+    for (char* it = buffer; it < buffer + length;) {
+      auto event = reinterpret_cast<inotify_event*>(it);
+      it += sizeof(inotify_event) + event->len;
+      auto directory = mDirectories.find(event->wd);
+      if (event->len == 0 || directory == mDirectories.end()) {
+        continue;
+      }
+      auto path = directory->second + event->name;
+      if (mFiles.count(path) &&
+          find(changed.begin(), changed.end(), path) == changed.end()) {
+        changed.push_back(move(path));
+      }
+    }
+  }
+#endif
+  return changed;
+}
+
+string
+FileWatcher::normalize(const string& file)
+{
+  return filesystem::path(file).lexically_normal().generic_string();
+}
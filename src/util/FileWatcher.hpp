@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief Reports changes to a set of files
+ *
+ * It watches the directories containing them, so files replaced by rename, as
+ * most editors save, are still seen. Uses inotify, on other platforms nothing
+ * is ever reported.
+ */
+class FileWatcher
+{
+public:
+  FileWatcher();
+  ~FileWatcher();
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher(FileWatcher&&)      = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+  FileWatcher& operator=(FileWatcher&&) = delete;
+
+  /**
+   * @brief Start watching a file, watching it twice is harmless
+   *
+   */
+  void watch(const std::string& file);
+
+  /**
+   * @brief Get the files changed since the last call, never blocks
+   *
+   * @return the changed files, each once, normalized as by normalize()
+   */
+  std::vector<std::string> poll();
+
+  /**
+   * @brief The form paths are reported in
+   *
+   */
+  static std::string normalize(const std::string& file);
+
+private:
+  int                                  mFd = -1;
+  std::unordered_map<int, std::string> mDirectories;
+  std::unordered_set<std::string>      mFiles;
+};
@@ -0,0 +1,134 @@
+#include "assetArchive.hpp"
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+
+using namespace std;
+
+/// Archive content is aligned to this, so any payload can be used in place
+constexpr size_t ASSET_ALIGNMENT = 16;
+
+static unique_ptr<AssetArchive> mountedArchive;
+
+static size_t
+alignOffset(size_t offset)
+{
+  return (offset + ASSET_ALIGNMENT - 1) & ~(ASSET_ALIGNMENT - 1);
+}
+
+AssetArchive::AssetArchive(const char* file)
+  : mFile(file)
+{
+  AssetArchiveHeader header;
+  auto               archive = mFile.view();
+  if (archive.size() < sizeof(header)) {
+    throw runtime_error("Invalid asset archive "s + file);
+  }
+  memcpy(&header, archive.data(), sizeof(header));
+  auto pathsOffset =
+    sizeof(header) + header.entries * sizeof(AssetArchiveEntry);
+  if (header.magic != ASSET_ARCHIVE_MAGIC ||
+      header.version != ASSET_ARCHIVE_VERSION ||
+      archive.size() < pathsOffset + header.pathBytes) {
+    throw runtime_error("Invalid asset archive "s + file);
+  }
+  auto paths = archive.substr(pathsOffset, header.pathBytes);
+  mEntries.reserve(header.entries);
+  for (unsigned i = 0; i < header.entries; ++i) {
+    AssetArchiveEntry entry;
+    memcpy(&entry,
+           archive.data() + sizeof(header) + i * sizeof(entry),
+           sizeof(entry));
+    if (entry.pathOffset + entry.pathSize > paths.size() ||
+        entry.offset + entry.size > archive.size()) {
+      throw runtime_error("Truncated asset archive "s + file);
+    }
+    mEntries.emplace(paths.substr(entry.pathOffset, entry.pathSize),
+                     archive.substr(entry.offset, entry.size));
+  }
+}
+
+optional<string_view>
+AssetArchive::find(string_view path) const
+{
+  auto it = mEntries.find(path);
+  if (it == mEntries.end()) {
+    it = mEntries.find(archivePath(path));
+  }
+  if (it == mEntries.end()) {
+    return nullopt;
+  }
+  return it->second;
+}
+
+string
+packAssets(const vector<pair<string, string>>& files)
+{
+  string paths;
+  for (auto& file : files) {
+    paths += archivePath(file.first);
+  }
+  AssetArchiveHeader header{ASSET_ARCHIVE_MAGIC,
+                            ASSET_ARCHIVE_VERSION,
+                            uint32_t(files.size()),
+                            uint32_t(paths.size())};
+  vector<AssetArchiveEntry> entries;
+  size_t offset = alignOffset(sizeof(header) +
+                              files.size() * sizeof(AssetArchiveEntry) +
+                              paths.size());
+  uint32_t pathOffset = 0;
+  for (auto& file : files) {
+    uint32_t pathSize = archivePath(file.first).size();
+    entries.push_back({offset, file.second.size(), pathOffset, pathSize});
+    pathOffset += pathSize;
+    offset = alignOffset(offset + file.second.size());
+  }
+
+  string result(offset, '\0');
+  memcpy(result.data(), &header, sizeof(header));
+  memcpy(result.data() + sizeof(header),
+         entries.data(),
+         entries.size() * sizeof(AssetArchiveEntry));
+  memcpy(result.data() + sizeof(header) +
+           entries.size() * sizeof(AssetArchiveEntry),
+         paths.data(),
+         paths.size());
+  for (size_t i = 0; i < files.size(); ++i) {
+    memcpy(result.data() + entries[i].offset,
+           files[i].second.data(),
+           files[i].second.size());
+  }
+  return result;
+}
+
+string
+archivePath(string_view path)
+{
+  return filesystem::path(path).lexically_normal().generic_string();
+}
+
+bool
+mountArchive(const char* file)
+{
+  if (!filesystem::exists(file)) {
+    return false;
+  }
+  mountedArchive = make_unique<AssetArchive>(file);
+  return true;
+}
+
+void
+unmountArchive()
+{
+  mountedArchive.reset();
+}
+
+optional<string_view>
+findArchivedFile(string_view path)
+{
+  if (!mountedArchive) {
+    return nullopt;
+  }
+  return mountedArchive->find(path);
+}
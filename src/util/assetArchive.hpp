@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "fileReader.hpp"
+
+/// "VXPK" when read as little endian
+constexpr uint32_t ASSET_ARCHIVE_MAGIC   = 0x4b505856;
+constexpr uint32_t ASSET_ARCHIVE_VERSION = 1;
+
+/// Where the tools look for an archive, see the packAssets target
+constexpr char ASSET_ARCHIVE_FILE[] = "assets.vxpak";
+
+/**
+ * @brief Header of an asset archive
+ *
+ * It is followed by `entries` AssetArchiveEntry, then by `pathBytes` of path
+ * characters and then by the file contents. Content offsets are relative to
+ * the archive start and 16 bytes aligned, so cooked textures can be uploaded
+ * straight from the mapping.
+ */
+struct AssetArchiveHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entries;
+  uint32_t pathBytes;
+};
+
+struct AssetArchiveEntry
+{
+  uint64_t offset;
+  uint64_t size;
+  uint32_t pathOffset;
+  uint32_t pathSize;
+};
+
+/**
+ * @brief A read only set of files packed together
+ *
+ */
+class AssetArchive
+{
+public:
+  explicit AssetArchive(const char* file);
+
+  /**
+   * @brief Find a file content
+   *
+   * @param path the path as it was given to packAssets()
+   * @return the content, pointing into the archive mapping, or nothing
+   */
+  std::optional<std::string_view> find(std::string_view path) const;
+
+  std::size_t size() const { return mEntries.size(); }
+
+private:
+  MappedFile                                             mFile;
+  std::unordered_map<std::string_view, std::string_view> mEntries;
+};
+
+/**
+ * @brief Serialize files into an archive
+ *
+ * @param files the path and content of each file
+ * @return std::string the archive bytes
+ */
+std::string
+packAssets(const std::vector<std::pair<std::string, std::string>>& files);
+
+/**
+ * @brief Normalize a path the way archive paths are stored
+ *
+ * So "./shaders/relief.vert" and "shaders/relief.vert" are the same entry.
+ */
+std::string
+archivePath(std::string_view path);
+
+/**
+ * @brief Make readFile() and MappedFile look into the archive first
+ *
+ * Files missing from it are still read from disk, so development can keep
+ * using loose files.
+ *
+ * @param file the archive path
+ * @return true if it was mounted, false if it does not exist
+ */
+bool
+mountArchive(const char* file);
+
+void
+unmountArchive();
+
+/**
+ * @brief Find a file content in the mounted archive
+ *
+ * @return the content or nothing if there is no archive or it is not there
+ */
+std::optional<std::string_view>
+findArchivedFile(std::string_view path);
@@ -1,17 +1,107 @@
 #include "fileReader.hpp"
 #include <fstream>
+#include <stdexcept>
+#include <utility>
+#ifdef __unix__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "assetArchive.hpp"
 
 using namespace std;
 
 string
 readFile(const char* file)
 {
-  string  result;
-  fstream fs(file);
-  char ch = fs.get();
-  while(fs) {
-    result += ch;
-    ch = fs.get();
+  if (auto archived = findArchivedFile(file)) {
+    return string(*archived);
   }
+  ifstream fs(file, ios::binary | ios::ate);
+  if (!fs) {
+    throw runtime_error("Can not open file "s + file);
+  }
+  string result(size_t(fs.tellg()), '\0');
+  fs.seekg(0);
+  fs.read(result.data(), result.size());
   return result;
 }
+
+MappedFile::MappedFile(const char* file)
+{
+  // The archive outlives any file, it is viewed in place
+  if (auto archived = findArchivedFile(file)) {
+    mData = archived->data();
+    mSize = archived->size();
+    return;
+  }
+#ifdef __unix__
+  int fd = open(file, O_RDONLY);
+  if (fd < 0) {
+    throw runtime_error("Can not open file "s + file);
+  }
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) < 0) {
+    close(fd);
+    throw runtime_error("Can not stat file "s + file);
+  }
+  mSize = fileStat.st_size;
+  if (mSize > 0) {
+    void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      mData   = static_cast<const char*>(data);
+      mMapped = true;
+    }
+  }
+  close(fd);
+  if (mMapped || mSize == 0) {
+    return;
+  }
+#endif
+  mBuffer = readFile(file);
+  mData   = mBuffer.data();
+  mSize   = mBuffer.size();
+}
+
+MappedFile::~MappedFile()
+{
+  mRelease();
+}
+
+MappedFile::MappedFile(MappedFile&& rhs)
+{
+  *this = move(rhs);
+}
+
+MappedFile&
+MappedFile::operator=(MappedFile&& rhs)
+{
+  if (this == &rhs) {
+    return *this;
+  }
+  mRelease();
+  bool buffered = rhs.mData == rhs.mBuffer.data();
+  mMapped       = rhs.mMapped;
+  mSize         = rhs.mSize;
+  mBuffer       = move(rhs.mBuffer);
+  mData         = buffered ? mBuffer.data() : rhs.mData;
+  rhs.mData   = nullptr;
+  rhs.mSize   = 0;
+  rhs.mMapped = false;
+  return *this;
+}
+
+void
+MappedFile::mRelease()
+{
+#ifdef __unix__
+  if (mMapped) {
+    munmap(const_cast<char*>(mData), mSize);
+  }
+#endif
+  mData   = nullptr;
+  mSize   = 0;
+  mMapped = false;
+  mBuffer.clear();
+}
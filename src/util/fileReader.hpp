@@ -1,5 +1,51 @@
 #pragma once
+#include <cstddef>
 #include <string>
+#include <string_view>
 
+/**
+ * @brief Read a whole file into a string
+ *
+ * The mounted archive is looked up first, see mountArchive(). Otherwise the
+ * size is queried first, so the content is read in a single call.
+ *
+ * @param file the file path
+ * @return std::string the content
+ */
 std::string
 readFile(const char* file);
+
+/**
+ * @brief A read only view of a whole file
+ *
+ * Files in the mounted archive are viewed in place. Others are memory mapped
+ * where the platform allows it, otherwise they are read into an owned buffer.
+ * Either way the content stays valid while the object lives.
+ */
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  explicit MappedFile(const char* file);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& rhs);
+  MappedFile& operator=(MappedFile&& rhs);
+
+  std::string_view view() const { return {mData, mSize}; }
+  const unsigned char* data() const
+  {
+    return reinterpret_cast<const unsigned char*>(mData);
+  }
+  std::size_t size() const { return mSize; }
+
+private:
+  void mRelease();
+
+private:
+  const char* mData   = nullptr;
+  std::size_t mSize   = 0;
+  bool        mMapped = false;
+  std::string mBuffer;
+};
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+constexpr uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ull;
+constexpr uint64_t FNV_PRIME        = 0x100000001b3ull;
+
+/**
+ * @brief FNV-1a hash, can be chained by passing the previous result as seed
+ *
+ * @param data the bytes to hash
+ * @param seed the starting value
+ * @return uint64_t the hash
+ */
+constexpr uint64_t
+fnv1a(std::string_view data, uint64_t seed = FNV_OFFSET_BASIS)
+{
+  for (char ch : data) {
+    seed = (seed ^ uint8_t(ch)) * FNV_PRIME;
+  }
+  return seed;
+}
@@ -0,0 +1,254 @@
+#include "textureCooking.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+size_t
+pixelFormatSize(PixelFormat format, int width, int height)
+{
+  size_t blocks = size_t((width + 3) / 4) * ((height + 3) / 4);
+  switch (format) {
+    case PixelFormat::RGB8:
+      return size_t(width) * height * 3;
+    case PixelFormat::RGBA8:
+      return size_t(width) * height * 4;
+    case PixelFormat::BC1:
+      return blocks * 8;
+    case PixelFormat::BC3:
+      return blocks * 16;
+    default:
+      throw logic_error("Invalid pixel format");
+  }
+}
+
+string
+cookedTexturePath(const string& sourcePath)
+{
+  return "cache/" + sourcePath + ".vxt";
+}
+
+/// 2x2 box filter, clamping at odd edges
+static vector<unsigned char>
+downsample(const vector<unsigned char>& pixels,
+           int                          width,
+           int                          height,
+           int                          channels)
+{
+  int                   newWidth  = max(width / 2, 1);
+  int                   newHeight = max(height / 2, 1);
+  vector<unsigned char> result(size_t(newWidth) * newHeight * channels);
+  for (int y = 0; y < newHeight; ++y) {
+    int y0 = min(y * 2, height - 1), y1 = min(y * 2 + 1, height - 1);
+    for (int x = 0; x < newWidth; ++x) {
+      int x0 = min(x * 2, width - 1), x1 = min(x * 2 + 1, width - 1);
+      for (int c = 0; c < channels; ++c) {
+        int sum = pixels[(y0 * width + x0) * channels + c] +
+                  pixels[(y0 * width + x1) * channels + c] +
+                  pixels[(y1 * width + x0) * channels + c] +
+                  pixels[(y1 * width + x1) * channels + c];
+        result[(y * newWidth + x) * channels + c] = (sum + 2) / 4;
+      }
+    }
+  }
+  return result;
+}
+
+static uint16_t
+packRgb565(const int* color)
+{
+  return uint16_t(((color[0] * 31 + 127) / 255) << 11 |
+                  ((color[1] * 63 + 127) / 255) << 5 |
+                  ((color[2] * 31 + 127) / 255));
+}
+
+static void
+unpackRgb565(uint16_t packed, int* color)
+{
+  color[0] = ((packed >> 11) & 31) * 255 / 31;
+  color[1] = ((packed >> 5) & 63) * 255 / 63;
+  color[2] = (packed & 31) * 255 / 31;
+}
+
+/// Encode the color part of a 4x4 block, always in 4 color mode
+static void
+encodeColorBlock(const unsigned char block[16][4], unsigned char* output)
+{
+  int minColor[3] = {255, 255, 255}, maxColor[3] = {0, 0, 0};
+  for (int i = 0; i < 16; ++i) {
+    for (int c = 0; c < 3; ++c) {
+      minColor[c] = min<int>(minColor[c], block[i][c]);
+      maxColor[c] = max<int>(maxColor[c], block[i][c]);
+    }
+  }
+  // Inset the bounding box a bit, reducing the error on the extremes
+  for (int c = 0; c < 3; ++c) {
+    int inset = (maxColor[c] - minColor[c]) / 16;
+    minColor[c] += inset;
+    maxColor[c] -= inset;
+  }
+  uint16_t color0 = packRgb565(maxColor);
+  uint16_t color1 = packRgb565(minColor);
+  if (color0 < color1) {
+    swap(color0, color1);
+  }
+  uint32_t indices = 0;
+  if (color0 != color1) {
+    int palette[4][3];
+    unpackRgb565(color0, palette[0]);
+    unpackRgb565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    for (int i = 0; i < 16; ++i) {
+      int bestIndex = 0, bestError = INT32_MAX;
+      for (int j = 0; j < 4; ++j) {
+        int error = 0;
+        for (int c = 0; c < 3; ++c) {
+          int diff = block[i][c] - palette[j][c];
+          error += diff * diff;
+        }
+        if (error < bestError) {
+          bestError = error;
+          bestIndex = j;
+        }
+      }
+      indices |= uint32_t(bestIndex) << (i * 2);
+    }
+  }
+  output[0] = color0 & 0xff;
+  output[1] = color0 >> 8;
+  output[2] = color1 & 0xff;
+  output[3] = color1 >> 8;
+  memcpy(output + 4, &indices, 4);
+}
+
+/// Encode the alpha part of a BC3 block, always in 8 alpha mode
+static void
+encodeAlphaBlock(const unsigned char block[16][4], unsigned char* output)
+{
+  int alpha0 = 0, alpha1 = 255;
+  for (int i = 0; i < 16; ++i) {
+    alpha0 = max<int>(alpha0, block[i][3]);
+    alpha1 = min<int>(alpha1, block[i][3]);
+  }
+  uint64_t indices = 0;
+  if (alpha0 != alpha1) {
+    int palette[8] = {alpha0, alpha1};
+    for (int j = 1; j < 7; ++j) {
+      palette[j + 1] = ((7 - j) * alpha0 + j * alpha1) / 7;
+    }
+    for (int i = 0; i < 16; ++i) {
+      int bestIndex = 0, bestError = INT32_MAX;
+      for (int j = 0; j < 8; ++j) {
+        int error = abs(block[i][3] - palette[j]);
+        if (error < bestError) {
+          bestError = error;
+          bestIndex = j;
+        }
+      }
+      indices |= uint64_t(bestIndex) << (i * 3);
+    }
+  }
+  output[0] = alpha0;
+  output[1] = alpha1;
+  for (int i = 0; i < 6; ++i) {
+    output[2 + i] = (indices >> (i * 8)) & 0xff;
+  }
+}
+
+static void
+compressLevel(const vector<unsigned char>& pixels,
+              int                          width,
+              int                          height,
+              int                          channels,
+              unsigned char*               output)
+{
+  for (int by = 0; by < height; by += 4) {
+    for (int bx = 0; bx < width; bx += 4) {
+      unsigned char block[16][4];
+      for (int i = 0; i < 16; ++i) {
+        int x = min(bx + i % 4, width - 1);
+        int y = min(by + i / 4, height - 1);
+        auto pixel  = &pixels[(size_t(y) * width + x) * channels];
+        block[i][0] = pixel[0];
+        block[i][1] = pixel[1];
+        block[i][2] = pixel[2];
+        block[i][3] = channels == 4 ? pixel[3] : 255;
+      }
+      if (channels == 4) {
+        encodeAlphaBlock(block, output);
+        output += 8;
+      }
+      encodeColorBlock(block, output);
+      output += 8;
+    }
+  }
+}
+
+string
+cookTexture(const unsigned char* pixels,
+            int                  width,
+            int                  height,
+            int                  channels,
+            bool                 compress)
+{
+  if (channels != 3 && channels != 4) {
+    throw runtime_error("Only RGB and RGBA textures can be cooked");
+  }
+  PixelFormat format;
+  if (compress) {
+    format = channels == 3 ? PixelFormat::BC1 : PixelFormat::BC3;
+  } else {
+    format = channels == 3 ? PixelFormat::RGB8 : PixelFormat::RGBA8;
+  }
+
+  uint32_t levels = 1;
+  for (int w = width, h = height; w > 1 || h > 1; ++levels) {
+    w = max(w / 2, 1);
+    h = max(h / 2, 1);
+  }
+  vector<CookedTextureLevel> levelInfo(levels);
+  size_t offset = sizeof(CookedTextureHeader) + levels * sizeof(levelInfo[0]);
+  for (uint32_t i = 0, w = width, h = height; i < levels; ++i) {
+    offset              = (offset + 15) & ~size_t(15);
+    levelInfo[i].width  = w;
+    levelInfo[i].height = h;
+    levelInfo[i].offset = offset;
+    levelInfo[i].size   = pixelFormatSize(format, w, h);
+    offset += levelInfo[i].size;
+    w = max(w / 2, 1u);
+    h = max(h / 2, 1u);
+  }
+
+  string              result(offset, '\0');
+  CookedTextureHeader header{COOKED_TEXTURE_MAGIC,
+                             COOKED_TEXTURE_VERSION,
+                             format,
+                             uint32_t(width),
+                             uint32_t(height),
+                             levels};
+  memcpy(result.data(), &header, sizeof(header));
+  memcpy(result.data() + sizeof(header),
+         levelInfo.data(),
+         levels * sizeof(levelInfo[0]));
+
+  vector<unsigned char> level(pixels,
+                              pixels + size_t(width) * height * channels);
+  for (uint32_t i = 0; i < levels; ++i) {
+    auto& info   = levelInfo[i];
+    auto  output = reinterpret_cast<unsigned char*>(&result[info.offset]);
+    if (compress) {
+      compressLevel(level, info.width, info.height, channels, output);
+    } else {
+      memcpy(output, level.data(), info.size);
+    }
+    if (i + 1 < levels) {
+      level = downsample(level, info.width, info.height, channels);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Layout of texture pixels, as stored on a cooked texture
+ *
+ */
+enum class PixelFormat : uint32_t
+{
+  RGB8,
+  RGBA8,
+  BC1,
+  BC3,
+};
+
+/// "VXTC" when read as little endian
+constexpr uint32_t COOKED_TEXTURE_MAGIC   = 0x43545856;
+constexpr uint32_t COOKED_TEXTURE_VERSION = 1;
+
+/**
+ * @brief Header of a cooked texture file
+ *
+ * It is followed by `levels` CookedTextureLevel entries and then by the pixels
+ * of each level. Level offsets are relative to the file start and 16 bytes
+ * aligned, so the file can be mapped and uploaded as is.
+ */
+struct CookedTextureHeader
+{
+  uint32_t    magic;
+  uint32_t    version;
+  PixelFormat format;
+  uint32_t    width;
+  uint32_t    height;
+  uint32_t    levels;
+};
+
+struct CookedTextureLevel
+{
+  uint32_t width;
+  uint32_t height;
+  uint32_t offset;
+  uint32_t size;
+};
+
+inline bool
+isCompressed(PixelFormat format)
+{
+  return format == PixelFormat::BC1 || format == PixelFormat::BC3;
+}
+
+/**
+ * @brief Number of bytes a single level takes
+ *
+ */
+std::size_t
+pixelFormatSize(PixelFormat format, int width, int height);
+
+/**
+ * @brief Build a cooked texture file, with its full mip chain
+ *
+ * @param pixels the level 0 pixels, tightly packed
+ * @param width the width in pixels
+ * @param height the height in pixels
+ * @param channels either 3 or 4
+ * @param compress if true it is stored as BC1 (3 channels) or BC3 (4
+ * channels), otherwise as RGB8 or RGBA8.
+ * @return std::string the file content
+ */
+std::string
+cookTexture(const unsigned char* pixels,
+            int                  width,
+            int                  height,
+            int                  channels,
+            bool                 compress);
+
+/**
+ * @brief Where the cooked version of a source file is expected to be
+ *
+ */
+std::string
+cookedTexturePath(const std::string& sourcePath);